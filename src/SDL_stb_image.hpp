@@ -9,6 +9,14 @@
 */
 SDL_Surface* STB_IMG_Load(const char* file);
 
+/**
+*  Load a surface from an encoded image in memory.
+*  The data is only read during the call.
+*
+*  \return the new surface, or nullptr if there was an error.
+*/
+SDL_Surface* STB_IMG_LoadFromMemory(const void* data, size_t size);
+
 /**
 *  Allocate surface.
 *
@@ -32,6 +40,8 @@ SDL_Surface* STB_IMG_CreateSurface(void* data, int width, int height, int comp,
 
 #include "stb_image.h"
 
+#include <climits>
+
 static SDL_Surface* STB_IMG_CreateSurface(void* data, int width, int height, int comp, bool free) {
 	SDL_Surface* surface = nullptr;
 
@@ -60,22 +70,61 @@ static SDL_Surface* STB_IMG_CreateSurface(void* data, int width, int height, int
 	return surface;
 }
 
-static SDL_Surface* STB_IMG_Load(const char* file) {
+// 1, 2 チャンネル (グレー、グレー + α) を RGB, RGBA に広げる、元の画素は解放する
+static stbi_uc* STB_IMG_ExpandGrey(stbi_uc* pixels, int width, int height, int comp) {
+	const int out_comp = comp + 2;
+	const size_t count = static_cast<size_t>(width) * height;
+	auto* expanded = static_cast<stbi_uc*>(SDL_malloc(count * out_comp));
+	if (expanded) {
+		for (size_t i = 0; i < count; ++i) {
+			const stbi_uc* src = pixels + i * comp;
+			stbi_uc* dst = expanded + i * out_comp;
+			dst[0] = dst[1] = dst[2] = src[0];
+			if (comp == STBI_grey_alpha) dst[3] = src[1];
+		}
+	}
+	stbi_image_free(pixels);
+	return expanded;
+}
+
+static SDL_Surface* STB_IMG_LoadFromMemory(const void* data, size_t size) {
 	SDL_Surface* surface = nullptr;
 
+	// stb_image は長さを int で受け取る
+	if (size > static_cast<size_t>(INT_MAX)) {
+		SDL_SetError("STB_IMG_LoadFromMemory: image data too large.");
+		return nullptr;
+	}
+
 	int width;
 	int height;
 	int comp;
 
-	auto info = stbi_info(file, &width, &height, &comp);
-	int req_comp = (comp == STBI_grey || comp == STBI_rgb) ? STBI_rgb : STBI_rgb_alpha;
+	// 元のチャンネル数のまま 1 回で読み、グレーだけ後から広げる
+	auto pixels = stbi_load_from_memory(static_cast<const stbi_uc*>(data), static_cast<int>(size), &width, &height, &comp, 0);
+	if (pixels != nullptr && (comp == STBI_grey || comp == STBI_grey_alpha)) {
+		pixels = STB_IMG_ExpandGrey(pixels, width, height, comp);
+		comp += 2;
+	}
 
-	auto data = stbi_load(file, &width, &height, &comp, req_comp);
-	if (data == nullptr) {
-		SDL_SetError("STB_IMG_LoadTexture: can't load.");
+	if (pixels == nullptr) {
+		SDL_SetError("STB_IMG_LoadFromMemory: can't load.");
 
 	} else {
-		surface = STB_IMG_CreateSurface(data, width, height, req_comp, true);
+		surface = STB_IMG_CreateSurface(pixels, width, height, comp, true);
+		if (surface == nullptr) stbi_image_free(pixels);
+	}
+
+	return surface;
+}
+
+static SDL_Surface* STB_IMG_Load(const char* file) {
+	SDL_Surface* surface = nullptr;
+
+	size_t size = 0;
+	if (auto* data = SDL_LoadFile(file, &size)) {
+		surface = STB_IMG_LoadFromMemory(data, size);
+		SDL_free(data);
 	}
 
 	return surface;
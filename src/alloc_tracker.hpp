@@ -0,0 +1,197 @@
+﻿#ifndef ALLOC_TRACKER_HPP_
+#define ALLOC_TRACKER_HPP_
+
+#include <atomic>
+#include <mutex>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/**
+*  Heap allocation counters, per frame and per instrumented scope.
+*
+*  Only active when built with WIZLIKE_TRACK_ALLOCATIONS; one translation
+*  unit must also define ALLOC_TRACKER_IMPLEMENTATION before including this
+*  header to replace the global operator new/delete. Otherwise the API still
+*  compiles but reports nothing, and ALLOC_SCOPE() expands to nothing.
+*/
+namespace alloc_tracker {
+
+struct counters {
+	std::uint64_t allocations = 0;
+	std::uint64_t bytes = 0;
+	std::uint64_t frees = 0;
+};
+
+static constexpr int max_scopes = 32;
+
+#if defined(WIZLIKE_TRACK_ALLOCATIONS)
+static constexpr bool enabled = true;
+#else
+static constexpr bool enabled = false;
+#endif
+
+namespace detail {
+
+struct atomic_counters {
+	std::atomic<std::uint64_t> allocations{ 0 };
+	std::atomic<std::uint64_t> bytes{ 0 };
+	std::atomic<std::uint64_t> frees{ 0 };
+
+	inline counters load() const {
+		return { allocations.load(std::memory_order_relaxed), bytes.load(std::memory_order_relaxed), frees.load(std::memory_order_relaxed) };
+	}
+};
+
+inline atomic_counters total;
+inline atomic_counters scopes[max_scopes];
+inline const char* scope_names[max_scopes];
+inline std::atomic<int> scope_count{ 0 };
+inline std::mutex scope_mutex;
+
+// 今いるスコープ、-1 ならどこにも属さない
+inline thread_local int current = -1;
+
+// ignore_this_thread() を呼んだスレッド
+inline thread_local bool ignored = false;
+
+// 前のフレームまでの累計と、前のフレームだけの値 (メインスレッドで使う)
+inline counters total_before;
+inline counters total_frame;
+inline counters scope_before[max_scopes];
+inline counters scope_frame[max_scopes];
+
+inline void record_allocation(std::size_t size) {
+	if (ignored) return;
+	total.allocations.fetch_add(1, std::memory_order_relaxed);
+	total.bytes.fetch_add(size, std::memory_order_relaxed);
+	if (current >= 0) {
+		scopes[current].allocations.fetch_add(1, std::memory_order_relaxed);
+		scopes[current].bytes.fetch_add(size, std::memory_order_relaxed);
+	}
+}
+
+inline void record_free() {
+	if (ignored) return;
+	total.frees.fetch_add(1, std::memory_order_relaxed);
+	if (current >= 0) scopes[current].frees.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline counters difference(const counters& now, const counters& before) {
+	return { now.allocations - before.allocations, now.bytes - before.bytes, now.frees - before.frees };
+}
+
+} // namespace detail
+
+// 同じ名前は同じスコープとして数える、ALLOC_SCOPE() から一度だけ呼ばれる
+inline int register_scope(const char* name) {
+	std::lock_guard<std::mutex> lock(detail::scope_mutex);
+	const int count = detail::scope_count.load();
+	for (int i = 0; i < count; ++i) {
+		if (std::strcmp(detail::scope_names[i], name) == 0) return i;
+	}
+	if (count >= max_scopes) return -1;
+	detail::scope_names[count] = name;
+	detail::scope_count.store(count + 1);
+	return count;
+}
+
+/**
+*  Stop counting allocations made on the calling thread, for threads whose
+*  work is not tied to frames. Every exemption weakens --alloc-check, so
+*  keep the callers few and say why at each one.
+*/
+inline void ignore_this_thread() { detail::ignored = true; }
+
+class scope {
+public:
+	explicit scope(int id) : _outer(detail::current) { if (id >= 0) detail::current = id; }
+	~scope() { detail::current = _outer; }
+
+	scope(const scope&) = delete;
+	scope& operator=(const scope&) = delete;
+
+private:
+	int _outer;
+};
+
+// application::boot() が描いたフレームの終わりに呼ぶ、描かずに眠った間の確保は次のフレームに入る
+inline void next_frame() {
+	const auto now = detail::total.load();
+	detail::total_frame = detail::difference(now, detail::total_before);
+	detail::total_before = now;
+	for (int i = 0; i < detail::scope_count.load(); ++i) {
+		const auto scope_now = detail::scopes[i].load();
+		detail::scope_frame[i] = detail::difference(scope_now, detail::scope_before[i]);
+		detail::scope_before[i] = scope_now;
+	}
+}
+
+// 直前のフレームの値
+inline const counters& frame() { return detail::total_frame; }
+
+inline int scope_count() { return detail::scope_count.load(); }
+inline const char* scope_name(int id) { return detail::scope_names[id]; }
+inline const counters& scope_frame(int id) { return detail::scope_frame[id]; }
+
+// 直前のフレームで計測スコープの中から確保された回数
+inline std::uint64_t scoped_allocations() {
+	std::uint64_t count = 0;
+	for (int i = 0; i < scope_count(); ++i) count += scope_frame(i).allocations;
+	return count;
+}
+
+} // namespace alloc_tracker
+
+#define ALLOC_TRACKER_CONCAT_(a, b) a##b
+#define ALLOC_TRACKER_CONCAT(a, b) ALLOC_TRACKER_CONCAT_(a, b)
+
+#if defined(WIZLIKE_TRACK_ALLOCATIONS)
+#define ALLOC_SCOPE(NAME) \
+	static const int ALLOC_TRACKER_CONCAT(alloc_scope_id_, __LINE__) = alloc_tracker::register_scope(NAME); \
+	alloc_tracker::scope ALLOC_TRACKER_CONCAT(alloc_scope_, __LINE__)(ALLOC_TRACKER_CONCAT(alloc_scope_id_, __LINE__))
+#else
+#define ALLOC_SCOPE(NAME) ((void)0)
+#endif
+
+#endif // ALLOC_TRACKER_HPP_
+
+#if defined(ALLOC_TRACKER_IMPLEMENTATION) && defined(WIZLIKE_TRACK_ALLOCATIONS) && !defined(ALLOC_TRACKER_IMPLEMENTED_)
+#define ALLOC_TRACKER_IMPLEMENTED_
+
+#include <cstdlib>
+#include <new>
+
+// アラインメント指定版は置き換えない (標準の実装のまま、数にも入らない)
+void* operator new(std::size_t size) {
+	alloc_tracker::detail::record_allocation(size);
+	if (void* p = std::malloc(size ? size : 1)) return p;
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+	return ::operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+	alloc_tracker::detail::record_allocation(size);
+	return std::malloc(size ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept {
+	return ::operator new(size, tag);
+}
+
+void operator delete(void* p) noexcept {
+	if (!p) return;
+	alloc_tracker::detail::record_free();
+	std::free(p);
+}
+
+void operator delete[](void* p) noexcept { ::operator delete(p); }
+void operator delete(void* p, std::size_t) noexcept { ::operator delete(p); }
+void operator delete[](void* p, std::size_t) noexcept { ::operator delete(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { ::operator delete(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { ::operator delete(p); }
+
+#endif // ALLOC_TRACKER_IMPLEMENTATION
@@ -4,8 +4,19 @@
 #include <SDL.h>
 #include <iostream>
 #include <memory>
+#include <vector>
+#include <string_view>
+#include <optional>
+#include <charconv>
+#include <algorithm>
 
 #include "util.hpp"
+#include "frame_arena.hpp"
+#include "alloc_tracker.hpp"
+#include "profiler.hpp"
+#include "trace_capture.hpp"
+#include "render.hpp"
+#include "sleep_timer.hpp"
 
 class application {
 public:
@@ -17,6 +28,21 @@ public:
 		return initialized();
 	}
 
+	void command_line(int argc, char** argv) {
+		_arguments.assign(argv + std::min(argc, 1), argv + argc);
+	}
+
+	// --name または --name=value、値が無ければ空文字列
+	std::optional<std::string_view> argument(std::string_view name) const {
+		for (auto arg : _arguments) {
+			if (arg.size() < name.size() + 2 || arg.substr(0, 2) != "--" || arg.substr(2, name.size()) != name) continue;
+			auto rest = arg.substr(2 + name.size());
+			if (rest.empty()) return rest;
+			if (rest.front() == '=') return rest.substr(1);
+		}
+		return std::nullopt;
+	}
+
 protected:
 	bool initialize(const char *title, int width, int height, Uint32 window_flags, Uint32 renderer_flags) {
 		if (_initialized) {
@@ -54,55 +80,292 @@ protected:
 	virtual void draw() {}
 	virtual void poll_event() {}
 
+	// 入力が無くても描き直したいとき (アニメーション中など) に true を返す
+	virtual bool needs_redraw() { return true; }
+
 public:
 	int boot() {
-		const int ms_frame = 1000 / 60;
-		Uint32 initial_ms = 0, elapsed_ms = 0;
+		if (!parse_alloc_check()) return 1;
+		parse_trace();
+
+		const Uint64 frequency = SDL_GetPerformanceFrequency();
+		SDL_RendererInfo info{};
+		const bool vsync = SDL_GetRendererInfo(renderer(), &info) == 0 && (info.flags & SDL_RENDERER_PRESENTVSYNC) != 0;
+
+		Uint64 previous = SDL_GetPerformanceCounter();
+		Uint64 frame_deadline = previous;
+		double accumulator = 0.0;
 		while (_running) {
-			initial_ms = SDL_GetTicks();
-
-			while (SDL_PollEvent(&_event)) {
-				poll_event();
-				switch (_event.type) {
-				case SDL_QUIT:
-					_running = false;
-					break;
-				case SDL_WINDOWEVENT:
-					{
-						switch (_event.window.event) {
-						case SDL_WINDOWEVENT_CLOSE:
-							if (_event.window.windowID == SDL_GetWindowID(window())) {
-								_running = false;
-							}
-							break;
-						}
-					}
-					break;
-				}
+			const Uint64 now = SDL_GetPerformanceCounter();
+			// 止まっていた後に更新をまとめて回しすぎないよう上限を付ける
+			accumulator += std::min(double(now - previous) / frequency, max_frame_seconds);
+			previous = now;
+
+			_frame_arena.reset();
+
+			if (poll_events()) _settle_frames = idle_settle_frames;
+
+			const double tick = 1.0 / _tick_rate;
+			while (accumulator >= tick) {
+				PROFILE_ZONE("update");
+				update(static_cast<float>(tick));
+				accumulator -= tick;
+			}
+			_tick_alpha = accumulator / tick;
+
+			const Uint32 window_flags = SDL_GetWindowFlags(window());
+			const bool hidden = (window_flags & (SDL_WINDOW_MINIMIZED | SDL_WINDOW_HIDDEN)) != 0;
+			const bool focused = (window_flags & SDL_WINDOW_INPUT_FOCUS) != 0;
+			const bool idle = idle_active();
+			if (idle && (hidden || (_settle_frames == 0 && !needs_redraw()))) {
+				// 次のイベントが来るまで描かずに眠る、待っていた時間は更新に回さない
+				SDL_WaitEventTimeout(nullptr, hidden ? idle_hidden_timeout_ms : focused ? idle_timeout_ms : idle_unfocused_timeout_ms);
+				previous = frame_deadline = SDL_GetPerformanceCounter();
+				accumulator = 0.0;
+				profiler::restart_frame();
+				continue;
+			}
+			if (_settle_frames > 0) --_settle_frames;
+
+			{
+				PROFILE_ZONE("draw");
+				draw();
+			}
+			{
+				PROFILE_ZONE("SDL_RenderPresent");
+				SDL_RenderPresent(renderer());
 			}
+			// 描かずに眠ったフレームは数えない (直前に描いたフレームの値が残る)
+			render::next_frame();
+			alloc_tracker::next_frame();
+			profiler::next_frame([this](const profiler::zone_event& e) { _trace.add(e); });
+			_trace.end_frame();
+			if (int exit_code = 0; check_allocations(exit_code)) return exit_code;
 
-			update();
+			// 垂直同期が効いているなら Present が待つので眠らない
+			// ただしフォーカスの無いウィンドウの上限は垂直同期があっても守る
+			const bool unfocused_cap = idle && !focused;
+			const double frame_rate_cap = unfocused_cap ? idle_unfocused_frame_rate : _frame_rate_cap;
+			if ((!vsync || unfocused_cap) && frame_rate_cap > 0.0) {
+				const Uint64 period = static_cast<Uint64>(frequency / frame_rate_cap);
+				frame_deadline += period;
+				if (const Uint64 current = SDL_GetPerformanceCounter(); current >= frame_deadline) {
+					// 間に合わなかったフレームの分は取り戻さない
+					frame_deadline = current;
 
-			draw();
-			SDL_RenderPresent(renderer());
+				} else {
+					// フォーカスの無いウィンドウは多少遅れてもよいので眠るだけにする
+					wait_until(frame_deadline, frequency, !unfocused_cap);
+				}
 
-			elapsed_ms = SDL_GetTicks() - initial_ms;
-			if (elapsed_ms < ms_frame) SDL_Delay(ms_frame - elapsed_ms);
+			} else {
+				// 上限を掛け始めたときに溜まった遅れを持ち越さない
+				frame_deadline = SDL_GetPerformanceCounter();
+			}
 		}
 
 		return 0;
 	}
 
+	/**
+	*  Logic ticks per second; update() is called with 1 / rate as its
+	*  deltatime as many times as the elapsed time allows.
+	*/
+	inline void tick_rate(double rate) { if (rate > 0.0) _tick_rate = rate; }
+	inline double tick_rate() const { return _tick_rate; }
+
+	// 描画の上限 (0 なら無制限)、垂直同期が有効なときは使わない
+	inline void frame_rate_cap(double rate) { _frame_rate_cap = std::max(rate, 0.0); }
+	inline double frame_rate_cap() const { return _frame_rate_cap; }
+
+	// 次の更新までの進み具合 [0, 1)、draw() で補間に使う
+	inline double tick_alpha() const { return _tick_alpha; }
+
+	/**
+	*  Idle mode skips draw-present while no input arrives and needs_redraw()
+	*  is false, blocking in SDL_WaitEventTimeout instead. Update ticks due
+	*  before the check still run; the time spent asleep is dropped, not
+	*  caught up. An unfocused window sleeps longer and draws at a lower
+	*  rate, vsync or not, and a minimized or hidden one never draws.
+	*  Suspended while --alloc-check or a trace capture runs, which need
+	*  frames that draw.
+	*/
+	inline void idle_mode(bool enable) { _idle_mode = enable; }
+	inline bool idle_mode() const { return _idle_mode; }
+
 protected:
 	inline SDL_Window*window() { return _window ? _window.get() : nullptr; }
 	inline SDL_Renderer*renderer() { return _renderer ? _renderer.get() : nullptr; }
 	inline auto *event() { return &_event; }
 
+	// 起動直後のキャッシュ作りなどを除くためのフレーム数
+	static constexpr int alloc_check_warmup = 120;
+	static constexpr int trace_default_frames = 300;
+
+	static constexpr double max_frame_seconds = 0.25;
+
+	// アイドル時の待ち時間と、入力の後に描き続けるフレーム数 (ImGui が落ち着くまで)
+	static constexpr int idle_timeout_ms = 100;
+	static constexpr int idle_unfocused_timeout_ms = 500;
+	static constexpr int idle_hidden_timeout_ms = 1000;
+	static constexpr double idle_unfocused_frame_rate = 10.0;
+	static constexpr int idle_settle_frames = 3;
+
+	// 1 フレームだけ使う一時データ用、ループの頭で巻き戻る
+	inline frame_arena& arena() { return _frame_arena; }
+
+	// 次の frames フレームぶんのゾーンを Chrome Trace 形式で書き出す
+	bool start_trace(std::string_view path, int frames = trace_default_frames) {
+		if (!profiler_enabled()) {
+			std::cerr << "trace capture needs a build with WIZLIKE_PROFILE" << std::endl;
+			return false;
+		}
+		return _trace.start(std::filesystem::path(path), frames);
+	}
+	inline void stop_trace() { _trace.stop(); }
+	inline bool tracing() const { return _trace.capturing(); }
+
 private:
+	// イベントがあったら true
+	bool poll_events() {
+		PROFILE_ZONE("poll_event");
+		bool received = false;
+		while (SDL_PollEvent(&_event)) {
+			received = true;
+			poll_event();
+			switch (_event.type) {
+			case SDL_QUIT:
+				_running = false;
+				break;
+			case SDL_KEYDOWN:
+				// F12 で取得開始、取得中にもう一度押すとそこで打ち切る
+				if (_event.key.keysym.sym == SDLK_F12 && !_event.key.repeat) {
+					if (tracing()) {
+						stop_trace();
+
+					} else {
+						start_trace(string_format(&_frame_arena, "trace_%d.json", _trace_count++));
+					}
+				}
+				break;
+			case SDL_WINDOWEVENT:
+				{
+					switch (_event.window.event) {
+					case SDL_WINDOWEVENT_CLOSE:
+						if (_event.window.windowID == SDL_GetWindowID(window())) {
+							_running = false;
+						}
+						break;
+					}
+				}
+				break;
+			}
+		}
+		return received;
+	}
+
+	/**
+	*  Sleep until deadline (performance counter units) without spinning.
+	*  A precise wait uses sleep_timer, which may still be late by the
+	*  scheduler's slack or, without a high-resolution timer, up to 1 ms
+	*  early; frame_deadline keeps advancing by whole periods, so the rate
+	*  evens out. Otherwise it sleeps with SDL_Delay, rounding up.
+	*/
+	void wait_until(Uint64 deadline, Uint64 frequency, bool precise) {
+		const Uint64 now = SDL_GetPerformanceCounter();
+		if (now >= deadline) return;
+		const Uint64 remaining = deadline - now;
+		if (precise) {
+			_sleep_timer.sleep(static_cast<std::uint64_t>(double(remaining) * 1000000000.0 / frequency));
+
+		} else {
+			SDL_Delay(static_cast<Uint32>((remaining * 1000 + frequency - 1) / frequency));
+		}
+	}
+
+	inline bool idle_active() const { return _idle_mode && _alloc_check_frames <= 0 && !_trace.capturing(); }
+
+	// --alloc-check=N: 慣らしの後、描いた N フレームの間にどこかでヒープから確保したら失敗
+	bool parse_alloc_check() {
+		if (auto value = argument("alloc-check")) {
+			if (!alloc_tracker::enabled) {
+				std::cerr << "--alloc-check needs a build with WIZLIKE_TRACK_ALLOCATIONS" << std::endl;
+				return false;
+			}
+			_alloc_check_frames = 600;
+			std::from_chars(value->data(), value->data() + value->size(), _alloc_check_frames);
+		}
+		return true;
+	}
+
+	// --trace[=file] で起動直後から、--trace-frames=N でフレーム数を指定
+	void parse_trace() {
+		int frames = trace_default_frames;
+		if (auto value = argument("trace-frames")) {
+			std::from_chars(value->data(), value->data() + value->size(), frames);
+		}
+		if (auto value = argument("trace")) {
+			start_trace(value->empty() ? std::string_view("trace.json") : *value, frames);
+		}
+	}
+
+	static constexpr bool profiler_enabled() {
+#if defined(WIZLIKE_PROFILE)
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	/**
+	*  Fail on any heap allocation in a drawn frame, counted over the whole
+	*  process, not only inside ALLOC_SCOPE blocks; the scopes only tell
+	*  where it happened. The only exemption is the trace writer thread,
+	*  which runs independently of frames (see trace_capture::write).
+	*  Returns true with exit_code set when the application should exit.
+	*/
+	bool check_allocations(int& exit_code) {
+		if (_alloc_check_frames <= 0 || ++_alloc_check_count <= alloc_check_warmup) return false;
+		if (auto& frame = alloc_tracker::frame(); frame.allocations > 0) {
+			std::cerr << "alloc check: frame " << _alloc_check_count << " allocated " << frame.allocations << " (" << frame.bytes << " bytes)" << std::endl;
+			const std::uint64_t scoped = alloc_tracker::scoped_allocations();
+			if (scoped < frame.allocations) std::cerr << "  (outside scopes): " << frame.allocations - scoped << std::endl;
+			for (int i = 0; i < alloc_tracker::scope_count(); ++i) {
+				auto& counters = alloc_tracker::scope_frame(i);
+				if (counters.allocations == 0) continue;
+				std::cerr << "  " << alloc_tracker::scope_name(i) << ": " << counters.allocations << " (" << counters.bytes << " bytes)" << std::endl;
+			}
+			exit_code = 1;
+			return true;
+		}
+		if (_alloc_check_count - alloc_check_warmup >= _alloc_check_frames) {
+			std::cout << "alloc check: " << _alloc_check_frames << " frames without allocations" << std::endl;
+			exit_code = 0;
+			return true;
+		}
+		return false;
+	}
+
 	SDL_Context _context;
 	SDL_Pointer<SDL_Window> _window;
 	SDL_Pointer<SDL_Renderer> _renderer;
 	SDL_Event _event{};
+	frame_arena _frame_arena;
+	sleep_timer _sleep_timer;
+	std::vector<std::string_view> _arguments;
+
+	double _tick_rate = 60.0;
+	double _frame_rate_cap = 60.0;
+	double _tick_alpha = 0.0;
+
+	bool _idle_mode = false;
+	int _settle_frames = idle_settle_frames;
+
+	int _alloc_check_frames = 0;
+	int _alloc_check_count = 0;
+
+	trace_capture _trace;
+	int _trace_count = 0;
 
 	bool _running = true;
 	bool _initialized = false;
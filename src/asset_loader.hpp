@@ -0,0 +1,144 @@
+﻿#ifndef ASSET_LOADER_HPP_
+#define ASSET_LOADER_HPP_
+
+#include <SDL.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "util.hpp"
+#include "SDL_stb_image.hpp"
+#include "asset_pack.hpp"
+
+/**
+*  Decodes images into SDL_Surfaces on worker threads.
+*  Textures are created from them on the render thread, on first get().
+*  Files are read through an asset_source (loose files if none is given).
+*/
+class asset_loader {
+public:
+	using surface_future = std::shared_future<SDL_Pointer<SDL_Surface>>;
+	using surface_processor = std::function<void(SDL_Surface*)>;
+
+	class texture_handle {
+	public:
+		texture_handle() {}
+		texture_handle(surface_future surface) : _surface(std::move(surface)) {}
+
+		inline bool valid() const { return _texture || _surface.valid(); }
+
+		inline bool ready() const {
+			return _texture || (_surface.valid() && _surface.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+		}
+
+		// 必要ならデコード完了を待ち、描画スレッドでテクスチャを作る
+		SDL_Pointer<SDL_Texture> get(SDL_Renderer* renderer) {
+			if (!_texture && _surface.valid()) {
+				if (auto surface = _surface.get()) {
+					_texture = make_texture_from_surface(renderer, surface.get());
+				}
+				_surface = {};
+			}
+			return _texture;
+		}
+
+		// デコード済みのピクセル、テクスチャを作った後は null
+		inline SDL_Pointer<SDL_Surface> surface() const {
+			return _surface.valid() ? _surface.get() : SDL_Pointer<SDL_Surface>{};
+		}
+
+	private:
+		surface_future _surface;
+		SDL_Pointer<SDL_Texture> _texture;
+	};
+
+	explicit asset_loader(std::shared_ptr<const asset_source> source = {}, unsigned int threads = 0)
+		: _source(source ? std::move(source) : std::make_shared<asset_source>()) {
+		if (threads == 0) {
+			threads = static_cast<unsigned int>(std::max(1, SDL_GetCPUCount() - 1));
+		}
+		for (unsigned int i = 0; i < threads; ++i) {
+			_workers.emplace_back([this] { work(); });
+		}
+	}
+
+	~asset_loader() {
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stopping = true;
+		}
+		_condition.notify_all();
+		for (auto& worker : _workers) {
+			worker.join();
+		}
+	}
+
+	asset_loader(const asset_loader&) = delete;
+	asset_loader& operator=(const asset_loader&) = delete;
+
+	template<typename F>
+	auto async(F&& f) -> std::future<std::invoke_result_t<F>> {
+		using result_type = std::invoke_result_t<F>;
+		auto task = std::make_shared<std::packaged_task<result_type()>>(std::forward<F>(f));
+		auto future = task->get_future();
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_tasks.emplace_back([task] { (*task)(); });
+		}
+		_condition.notify_one();
+		return future;
+	}
+
+	surface_future load_surface(const std::filesystem::path& path, surface_processor process = {}) {
+		return async([source = _source, path, process = std::move(process)] {
+			SDL_Pointer<SDL_Surface> surface;
+			auto data = source->load(path);
+			if (auto* p = data ? STB_IMG_LoadFromMemory(data.data, data.size) : nullptr) {
+				surface = SDL_Pointer<SDL_Surface>(p, SDL_FreeSurface);
+				if (process) process(p);
+			}
+			return surface;
+		}).share();
+	}
+
+	inline texture_handle load_texture(const std::filesystem::path& path, surface_processor process = {}) {
+		return { load_surface(path, std::move(process)) };
+	}
+
+	inline std::size_t thread_count() const { return _workers.size(); }
+	inline const asset_source& source() const { return *_source; }
+
+private:
+	void work() {
+		while (true) {
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_condition.wait(lock, [this] { return _stopping || !_tasks.empty(); });
+				// 終了時も積まれているタスクは消化する
+				if (_tasks.empty()) break;
+				task = std::move(_tasks.front());
+				_tasks.pop_front();
+			}
+			task();
+		}
+	}
+
+	std::shared_ptr<const asset_source> _source;
+	std::vector<std::thread> _workers;
+	std::deque<std::function<void()>> _tasks;
+	std::mutex _mutex;
+	std::condition_variable _condition;
+	bool _stopping = false;
+};
+
+#endif // ASSET_LOADER_HPP_
@@ -0,0 +1,273 @@
+﻿#ifndef ASSET_PACK_HPP_
+#define ASSET_PACK_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <iterator>
+#include <filesystem>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+*  Pack file layout (little endian):
+*
+*    header  "WZPK", u32 version, u32 entry count, u32 reserved, u64 index offset
+*    data    file contents, each aligned to 16 bytes
+*    names   normalized paths, back to back (no terminator)
+*    index   entry count * { u64 path hash, u64 offset, u64 size, u64 name offset, u64 name size }, sorted by hash
+*/
+namespace asset_pack_format {
+
+constexpr char magic[4] = { 'W', 'Z', 'P', 'K' };
+constexpr std::uint32_t version = 2;
+constexpr std::size_t header_size = 24;
+constexpr std::size_t entry_size = 40;
+constexpr std::size_t alignment = 16;
+
+// 区切りを '/' に揃え、先頭の "./" を落とす
+inline std::string normalize_path(std::string_view path) {
+	std::string result(path);
+	for (auto& ch : result) {
+		if (ch == '\\') ch = '/';
+	}
+	while (result.compare(0, 2, "./") == 0) result.erase(0, 2);
+	return result;
+}
+
+// FNV-1a 64
+inline std::uint64_t hash_path(std::string_view path) {
+	std::uint64_t hash = 0xcbf29ce484222325ull;
+	for (char ch : normalize_path(path)) {
+		hash ^= static_cast<unsigned char>(ch);
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+inline std::uint64_t read_u64(const unsigned char* p) {
+	std::uint64_t value = 0;
+	for (int i = 0; i < 8; ++i) value |= std::uint64_t(p[i]) << (8 * i);
+	return value;
+}
+
+inline std::uint32_t read_u32(const unsigned char* p) {
+	return std::uint32_t(p[0]) | (std::uint32_t(p[1]) << 8) | (std::uint32_t(p[2]) << 16) | (std::uint32_t(p[3]) << 24);
+}
+
+} // namespace asset_pack_format
+
+/**
+*  Read-only memory mapping of a whole file.
+*/
+class mapped_file {
+public:
+	mapped_file() {}
+	~mapped_file() { close(); }
+
+	mapped_file(const mapped_file&) = delete;
+	mapped_file& operator=(const mapped_file&) = delete;
+
+	bool open(const std::filesystem::path& path) {
+		close();
+#ifdef _WIN32
+		_file = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (_file == INVALID_HANDLE_VALUE) return false;
+		LARGE_INTEGER size{};
+		if (!GetFileSizeEx(_file, &size) || size.QuadPart == 0) { close(); return false; }
+		_mapping = CreateFileMappingW(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!_mapping) { close(); return false; }
+		_data = static_cast<const unsigned char*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+		if (!_data) { close(); return false; }
+		_size = static_cast<std::size_t>(size.QuadPart);
+#else
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) return false;
+		struct stat st {};
+		if (fstat(fd, &st) != 0 || st.st_size <= 0) { ::close(fd); return false; }
+		void* p = mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (p == MAP_FAILED) return false;
+		_data = static_cast<const unsigned char*>(p);
+		_size = static_cast<std::size_t>(st.st_size);
+#endif
+		return true;
+	}
+
+	void close() {
+#ifdef _WIN32
+		if (_data) UnmapViewOfFile(_data);
+		if (_mapping) CloseHandle(_mapping);
+		if (_file != INVALID_HANDLE_VALUE) CloseHandle(_file);
+		_mapping = nullptr;
+		_file = INVALID_HANDLE_VALUE;
+#else
+		if (_data) munmap(const_cast<unsigned char*>(_data), _size);
+#endif
+		_data = nullptr;
+		_size = 0;
+	}
+
+	inline const unsigned char* data() const { return _data; }
+	inline std::size_t size() const { return _size; }
+	inline explicit operator bool() const { return _data != nullptr; }
+
+private:
+	const unsigned char* _data = nullptr;
+	std::size_t _size = 0;
+#ifdef _WIN32
+	HANDLE _file = INVALID_HANDLE_VALUE;
+	HANDLE _mapping = nullptr;
+#endif
+};
+
+/**
+*  Bytes of one asset. Entries from a pack point straight into the mapping
+*  and keep it alive through owner; loose files own a heap copy.
+*/
+struct asset_data {
+	const unsigned char* data = nullptr;
+	std::size_t size = 0;
+	std::shared_ptr<const void> owner;
+
+	inline bool empty() const { return data == nullptr; }
+	inline explicit operator bool() const { return !empty(); }
+};
+
+class asset_pack : public std::enable_shared_from_this<asset_pack> {
+public:
+	asset_pack() {}
+
+	bool open(const std::filesystem::path& path) {
+		using namespace asset_pack_format;
+
+		if (!_file.open(path)) return false;
+		auto* p = _file.data();
+		auto size = _file.size();
+		if (size < header_size || std::memcmp(p, magic, sizeof(magic)) != 0 || read_u32(p + 4) != version) {
+			_file.close();
+			return false;
+		}
+		auto count = read_u32(p + 8);
+		auto index_offset = read_u64(p + 16);
+		if (index_offset > size || (size - index_offset) / entry_size < count) {
+			_file.close();
+			return false;
+		}
+		_index = p + index_offset;
+		_count = count;
+		return true;
+	}
+
+	asset_data find(std::string_view path) const {
+		using namespace asset_pack_format;
+
+		asset_data result;
+		if (!_file) return result;
+
+		// ハッシュが同じでもパスまで一致したものだけを返す
+		const auto name = normalize_path(path);
+		const auto hash = hash_path(name);
+		std::size_t lo = 0, hi = _count;
+		while (lo < hi) {
+			auto mid = lo + (hi - lo) / 2;
+			if (read_u64(_index + mid * entry_size) < hash) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+		for (; lo < _count && read_u64(_index + lo * entry_size) == hash; ++lo) {
+			auto* entry = _index + lo * entry_size;
+			if (!same_name(entry, name)) continue;
+			auto offset = read_u64(entry + 8);
+			auto size = read_u64(entry + 16);
+			if (offset <= _file.size() && size <= _file.size() - offset) {
+				result.data = _file.data() + offset;
+				result.size = static_cast<std::size_t>(size);
+				result.owner = shared_from_this();
+			}
+			break;
+		}
+		return result;
+	}
+
+	inline std::size_t size() const { return _count; }
+
+private:
+	bool same_name(const unsigned char* entry, std::string_view name) const {
+		using namespace asset_pack_format;
+		auto offset = read_u64(entry + 24);
+		auto size = read_u64(entry + 32);
+		return size == name.size() && offset <= _file.size() && size <= _file.size() - offset
+			&& std::memcmp(_file.data() + offset, name.data(), name.size()) == 0;
+	}
+
+	mapped_file _file;
+	const unsigned char* _index = nullptr;
+	std::size_t _count = 0;
+};
+
+/**
+*  Packs stacked over loose files. Packs mounted later overlay earlier ones,
+*  so a mod pack only needs to contain the files it replaces.
+*  Mount everything before handing the source to loader threads.
+*/
+class asset_source {
+public:
+	asset_source() {}
+
+	bool mount(const std::filesystem::path& path) {
+		auto pack = std::make_shared<asset_pack>();
+		if (!pack->open(path)) return false;
+		_packs.push_back(pack);
+		return true;
+	}
+
+	inline void loose_files(bool enable) { _loose_files = enable; }
+
+	asset_data load(const std::filesystem::path& path) const {
+		auto name = path.generic_string();
+		for (auto it = _packs.rbegin(); it != _packs.rend(); ++it) {
+			if (auto data = (*it)->find(name)) return data;
+		}
+
+		asset_data result;
+		if (_loose_files) {
+			std::ifstream file(path, std::ios::binary);
+			if (file) {
+				auto buffer = std::make_shared<std::vector<unsigned char>>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+				result.data = buffer->data();
+				result.size = buffer->size();
+				result.owner = buffer;
+			}
+		}
+		return result;
+	}
+
+	inline std::size_t pack_count() const { return _packs.size(); }
+
+private:
+	std::vector<std::shared_ptr<asset_pack>> _packs;
+	bool _loose_files = true;
+};
+
+#endif // ASSET_PACK_HPP_
@@ -0,0 +1,547 @@
+﻿#ifndef BMFONT_HPP_
+#define BMFONT_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fstream>
+#include <iterator>
+#include <filesystem>
+#include <charconv>
+#include <type_traits>
+
+#include <pugixml.hpp>
+
+#include "codepoint_table.hpp"
+
+struct bmf_font {
+	struct bmf_info {
+		std::string face;
+		int size = 0;
+		bool bold = false;
+		bool italic = false;
+		std::string charset;
+		bool unicode = false;
+		float stretchH = 100.f;
+		bool smooth = false;
+		bool aa = false;
+		struct bmf_padding {
+			int up, right, down, left;
+		} padding{ 0 };
+		struct bmf_spacing {
+			int horizontal, vertical;
+		} spacing{ 0 };
+		int outline = 0;
+	} info;
+	struct bmf_common {
+		int line_height;
+		int base;
+		int scale_width;
+		int scale_height;
+		int pages;
+		bool packed;
+		enum bmf_channel {
+			glyph = 0,
+			outline,
+			encoded_glyph_and_outline,
+			zero,
+			one,
+		};
+		bmf_channel alpha_channel;
+		bmf_channel red_channel;
+		bmf_channel green_channel;
+		bmf_channel blue_channel;
+	} common;
+	struct bmf_page {
+		int id;
+		std::string file;
+	};
+	std::vector<bmf_page> pages;
+	struct bmf_char {
+		char32_t id;
+		std::uint16_t x, y;
+		std::uint16_t width, height;
+		std::int16_t x_offset, y_offset;
+		std::int16_t x_advance;
+		std::uint8_t page;
+		enum bmf_texture_channel {
+			blue = 1 << 0,
+			green = 1 << 1,
+			red = 1 << 2,
+			alpha = 1 << 3,
+		};
+		std::uint8_t channel;
+	};
+	static_assert(sizeof(bmf_char) == 20, "bmf_char should stay compact");
+
+	class bmf_char_table {
+	public:
+		using index_type = std::uint16_t;
+		static constexpr index_type npos = 0xFFFF;
+
+		inline const bmf_char* find(char32_t codepoint) const {
+			auto index = _index.find(codepoint);
+			return (index != npos) ? &_chars[index] : nullptr;
+		}
+
+		inline index_type index_of(char32_t codepoint) const {
+			return _index.find(codepoint);
+		}
+
+		inline const bmf_char& operator[](index_type index) const { return _chars[index]; }
+
+		void insert(const bmf_char& chara) {
+			if (auto index = _index.find(chara.id); index != npos) {
+				_chars[index] = chara;
+
+			} else if (_chars.size() < npos) {
+				_index.insert(chara.id, static_cast<index_type>(_chars.size()));
+				_chars.push_back(chara);
+			}
+		}
+
+		void assign(std::vector<bmf_char>&& chars) {
+			clear();
+			if (chars.size() >= npos) chars.resize(npos - 1);
+			_chars = std::move(chars);
+			for (std::size_t i = 0; i < _chars.size(); ++i) {
+				_index.insert(_chars[i].id, static_cast<index_type>(i));
+			}
+		}
+
+		void clear() {
+			_chars.clear();
+			_index.clear();
+		}
+
+		inline std::size_t size() const { return _chars.size(); }
+		inline auto begin() { return _chars.begin(); }
+		inline auto end() { return _chars.end(); }
+		inline auto begin() const { return _chars.begin(); }
+		inline auto end() const { return _chars.end(); }
+
+		std::size_t memory_usage() const {
+			return _index.memory_usage() + _chars.capacity() * sizeof(bmf_char);
+		}
+
+	private:
+		std::vector<bmf_char> _chars;
+		codepoint_table<index_type, npos> _index;
+	};
+	bmf_char_table chars;
+};
+
+namespace bmf_detail {
+
+inline int to_int(std::string_view str) {
+	int value = 0;
+	std::from_chars(str.data(), str.data() + str.size(), value);
+	return value;
+}
+
+template<std::size_t N>
+inline void to_int_list(std::string_view str, int (&out)[N]) {
+	for (std::size_t i = 0; i < N && !str.empty(); ++i) {
+		auto comma = str.find(',');
+		out[i] = to_int(str.substr(0, comma));
+		str = (comma == std::string_view::npos) ? std::string_view{} : str.substr(comma + 1);
+	}
+}
+
+template<typename T>
+inline T read_le(const unsigned char* p) {
+	using U = std::make_unsigned_t<T>;
+	U value = 0;
+	for (std::size_t i = 0; i < sizeof(T); ++i) value |= static_cast<U>(U(p[i]) << (8 * i));
+	return static_cast<T>(value);
+}
+
+template<typename T>
+inline void write_le(std::vector<unsigned char>& out, T value) {
+	using U = std::make_unsigned_t<T>;
+	auto u = static_cast<U>(value);
+	for (std::size_t i = 0; i < sizeof(T); ++i) out.push_back(static_cast<unsigned char>(u >> (8 * i)));
+}
+
+inline bool is_little_endian() {
+	const std::uint16_t value = 1;
+	unsigned char byte = 0;
+	std::memcpy(&byte, &value, 1);
+	return byte == 1;
+}
+
+// XML とテキスト形式の共通部分: get(name) は属性値を返す
+template<typename Get>
+void read_info(bmf_font& bmfont, Get&& get) {
+	bmfont.info.face = std::string(get("face"));
+	bmfont.info.size = to_int(get("size"));
+	bmfont.info.bold = to_int(get("bold")) != 0;
+	bmfont.info.italic = to_int(get("italic")) != 0;
+	bmfont.info.charset = std::string(get("charset"));
+	bmfont.info.unicode = to_int(get("unicode")) != 0;
+	bmfont.info.stretchH = static_cast<float>(to_int(get("stretchH")));
+	bmfont.info.smooth = to_int(get("smooth")) != 0;
+	bmfont.info.aa = to_int(get("aa")) != 0;
+	{
+		int list[4]{};
+		to_int_list(get("padding"), list);
+		bmfont.info.padding = { list[0], list[1], list[2], list[3] };
+	}
+	{
+		int list[2]{};
+		to_int_list(get("spacing"), list);
+		bmfont.info.spacing = { list[0], list[1] };
+	}
+	bmfont.info.outline = to_int(get("outline"));
+}
+
+template<typename Get>
+void read_common(bmf_font& bmfont, Get&& get) {
+	using channel = decltype(bmfont.common.alpha_channel);
+	bmfont.common.line_height = to_int(get("lineHeight"));
+	bmfont.common.base = to_int(get("base"));
+	bmfont.common.scale_width = to_int(get("scaleW"));
+	bmfont.common.scale_height = to_int(get("scaleH"));
+	bmfont.common.pages = to_int(get("pages"));
+	bmfont.common.packed = to_int(get("packed")) != 0;
+	bmfont.common.alpha_channel = channel(to_int(get("alphaChnl")));
+	bmfont.common.red_channel = channel(to_int(get("redChnl")));
+	bmfont.common.green_channel = channel(to_int(get("greenChnl")));
+	bmfont.common.blue_channel = channel(to_int(get("blueChnl")));
+}
+
+template<typename Get>
+void read_page(bmf_font& bmfont, Get&& get) {
+	bmfont.pages.push_back({ to_int(get("id")), std::string(get("file")) });
+}
+
+template<typename Get>
+bmf_font::bmf_char read_char(Get&& get) {
+	bmf_font::bmf_char c{};
+	c.id = static_cast<char32_t>(to_int(get("id")));
+	c.x = static_cast<std::uint16_t>(to_int(get("x")));
+	c.y = static_cast<std::uint16_t>(to_int(get("y")));
+	c.width = static_cast<std::uint16_t>(to_int(get("width")));
+	c.height = static_cast<std::uint16_t>(to_int(get("height")));
+	c.x_offset = static_cast<std::int16_t>(to_int(get("xoffset")));
+	c.y_offset = static_cast<std::int16_t>(to_int(get("yoffset")));
+	c.x_advance = static_cast<std::int16_t>(to_int(get("xadvance")));
+	c.page = static_cast<std::uint8_t>(to_int(get("page")));
+	c.channel = static_cast<std::uint8_t>(to_int(get("chnl")));
+	return c;
+}
+
+} // namespace bmf_detail
+
+enum class bmf_format {
+	unknown,
+	xml,
+	text,
+	binary,
+};
+
+inline bmf_format detect_bmfont_format(const void* data, std::size_t size) {
+	auto* p = static_cast<const char*>(data);
+	if (size >= 4 && p[0] == 'B' && p[1] == 'M' && p[2] == 'F') {
+		return (p[3] == 3) ? bmf_format::binary : bmf_format::unknown;
+	}
+	std::string_view text(p, size);
+	if (text.substr(0, 3) == "\xEF\xBB\xBF") text.remove_prefix(3);
+	text.remove_prefix(std::min(text.find_first_not_of(" \t\r\n"), text.size()));
+	if (text.substr(0, 1) == "<") return bmf_format::xml;
+	if (text.substr(0, 5) == "info ") return bmf_format::text;
+	return bmf_format::unknown;
+}
+
+inline bool load_bmfont_xml(const void* data, std::size_t size, bmf_font& bmfont) {
+	pugi::xml_document doc;
+	if (!doc.load_buffer(data, size)) return false;
+
+	auto font = doc.child("font");
+	if (!font) return false;
+	auto attributes = [](const pugi::xml_node& node) {
+		return [node](const char* name) { return std::string_view(node.attribute(name).as_string()); };
+	};
+	bmf_detail::read_info(bmfont, attributes(font.child("info")));
+	bmf_detail::read_common(bmfont, attributes(font.child("common")));
+	for (auto& page : font.child("pages").children("page")) {
+		bmf_detail::read_page(bmfont, attributes(page));
+	}
+	for (auto& chara : font.child("chars").children("char")) {
+		bmfont.chars.insert(bmf_detail::read_char(attributes(chara)));
+	}
+	return true;
+}
+
+inline bool load_bmfont_text(const void* data, std::size_t size, bmf_font& bmfont) {
+	std::string_view text(static_cast<const char*>(data), size);
+	std::vector<std::pair<std::string_view, std::string_view>> attributes;
+	auto get = [&attributes](const char* name) {
+		for (auto& [key, value] : attributes) {
+			if (key == name) return value;
+		}
+		return std::string_view{};
+	};
+
+	bool found_info = false;
+	while (!text.empty()) {
+		auto eol = text.find('\n');
+		auto line = text.substr(0, eol);
+		text = (eol == std::string_view::npos) ? std::string_view{} : text.substr(eol + 1);
+
+		// タグ名 key=value key="quoted value" ...
+		attributes.clear();
+		std::string_view tag;
+		while (!line.empty()) {
+			line.remove_prefix(std::min(line.find_first_not_of(" \t\r"), line.size()));
+			if (line.empty()) break;
+			auto end = line.find_first_of(" \t\r=");
+			auto key = line.substr(0, end);
+			line.remove_prefix(key.size());
+			if (line.empty() || line.front() != '=') {
+				if (tag.empty()) tag = key;
+				continue;
+			}
+			line.remove_prefix(1);
+			std::string_view value;
+			if (!line.empty() && line.front() == '"') {
+				auto close = line.find('"', 1);
+				value = line.substr(1, close - 1);
+				line.remove_prefix(std::min(close + 1, line.size()));
+
+			} else {
+				value = line.substr(0, line.find_first_of(" \t\r"));
+				line.remove_prefix(value.size());
+			}
+			attributes.emplace_back(key, value);
+		}
+
+		if (tag == "info") {
+			bmf_detail::read_info(bmfont, get);
+			found_info = true;
+
+		} else if (tag == "common") {
+			bmf_detail::read_common(bmfont, get);
+
+		} else if (tag == "page") {
+			bmf_detail::read_page(bmfont, get);
+
+		} else if (tag == "char") {
+			bmfont.chars.insert(bmf_detail::read_char(get));
+		}
+	}
+	return found_info;
+}
+
+inline bool load_bmfont_binary(const void* data, std::size_t size, bmf_font& bmfont) {
+	using bmf_detail::read_le;
+
+	auto* p = static_cast<const unsigned char*>(data);
+	auto* end = p + size;
+	if (detect_bmfont_format(data, size) != bmf_format::binary) return false;
+	p += 4;
+
+	while (end - p >= 5) {
+		const auto type = p[0];
+		const auto block_size = read_le<std::uint32_t>(p + 1);
+		p += 5;
+		if (std::size_t(end - p) < block_size) return false;
+		const auto* block = p;
+		p += block_size;
+
+		switch (type) {
+		case 1: // info
+			if (block_size < 15) return false;
+			bmfont.info.size = read_le<std::int16_t>(block);
+			bmfont.info.smooth = (block[2] & (1 << 7)) != 0;
+			bmfont.info.unicode = (block[2] & (1 << 6)) != 0;
+			bmfont.info.italic = (block[2] & (1 << 5)) != 0;
+			bmfont.info.bold = (block[2] & (1 << 4)) != 0;
+			bmfont.info.charset = bmfont.info.unicode ? std::string{} : std::to_string(block[3]);
+			bmfont.info.stretchH = read_le<std::uint16_t>(block + 4);
+			bmfont.info.aa = block[6] != 0;
+			bmfont.info.padding = { block[7], block[8], block[9], block[10] };
+			bmfont.info.spacing = { block[11], block[12] };
+			bmfont.info.outline = block[13];
+			bmfont.info.face.assign(reinterpret_cast<const char*>(block + 14), strnlen(reinterpret_cast<const char*>(block + 14), block_size - 14));
+			break;
+
+		case 2: // common
+			{
+				if (block_size < 15) return false;
+				using channel = decltype(bmfont.common.alpha_channel);
+				bmfont.common.line_height = read_le<std::uint16_t>(block);
+				bmfont.common.base = read_le<std::uint16_t>(block + 2);
+				bmfont.common.scale_width = read_le<std::uint16_t>(block + 4);
+				bmfont.common.scale_height = read_le<std::uint16_t>(block + 6);
+				bmfont.common.pages = read_le<std::uint16_t>(block + 8);
+				// 仕様はビットを上位から数えるので、info と同じく「bit 7」は 0x01
+				bmfont.common.packed = (block[10] & 0x01) != 0;
+				bmfont.common.alpha_channel = channel(block[11]);
+				bmfont.common.red_channel = channel(block[12]);
+				bmfont.common.green_channel = channel(block[13]);
+				bmfont.common.blue_channel = channel(block[14]);
+			}
+			break;
+
+		case 3: // pages
+			for (std::uint32_t offset = 0; offset < block_size;) {
+				auto* name = reinterpret_cast<const char*>(block + offset);
+				auto length = strnlen(name, block_size - offset);
+				bmfont.pages.push_back({ static_cast<int>(bmfont.pages.size()), std::string(name, length) });
+				offset += static_cast<std::uint32_t>(length + 1);
+			}
+			break;
+
+		case 4: // chars
+			{
+				std::vector<bmf_font::bmf_char> chars(block_size / sizeof(bmf_font::bmf_char));
+				if (bmf_detail::is_little_endian()) {
+					std::memcpy(chars.data(), block, chars.size() * sizeof(bmf_font::bmf_char));
+
+				} else {
+					for (std::size_t i = 0; i < chars.size(); ++i) {
+						auto* c = block + i * sizeof(bmf_font::bmf_char);
+						chars[i].id = read_le<std::uint32_t>(c);
+						chars[i].x = read_le<std::uint16_t>(c + 4);
+						chars[i].y = read_le<std::uint16_t>(c + 6);
+						chars[i].width = read_le<std::uint16_t>(c + 8);
+						chars[i].height = read_le<std::uint16_t>(c + 10);
+						chars[i].x_offset = read_le<std::int16_t>(c + 12);
+						chars[i].y_offset = read_le<std::int16_t>(c + 14);
+						chars[i].x_advance = read_le<std::int16_t>(c + 16);
+						chars[i].page = c[18];
+						chars[i].channel = c[19];
+					}
+				}
+				bmfont.chars.assign(std::move(chars));
+			}
+			break;
+
+		default: // kerning pairs etc.
+			break;
+		}
+	}
+	return true;
+}
+
+inline bool load_bmfont(const void* data, std::size_t size, bmf_font& bmfont) {
+	switch (detect_bmfont_format(data, size)) {
+	case bmf_format::binary: return load_bmfont_binary(data, size, bmfont);
+	case bmf_format::text: return load_bmfont_text(data, size, bmfont);
+	case bmf_format::xml: return load_bmfont_xml(data, size, bmfont);
+	default: return false;
+	}
+}
+
+inline bool read_file(const std::filesystem::path& path, std::vector<unsigned char>& out) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file) return false;
+	out.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	return true;
+}
+
+/**
+*  Path of the pre-converted binary next to a .fnt ("font.fnt" -> "font.bfnt").
+*/
+inline std::filesystem::path bmfont_binary_path(const std::filesystem::path& path) {
+	return std::filesystem::path(path).replace_extension(".bfnt");
+}
+
+/**
+*  Load a BMFont file in XML, text or binary v3 format.
+*  A converted binary next to the file takes priority over the file itself.
+*/
+inline bool load_bmfont(const std::filesystem::path& path, bmf_font& bmfont) {
+	std::vector<unsigned char> data;
+	if (auto binary = bmfont_binary_path(path); binary != path && read_file(binary, data) && load_bmfont(data.data(), data.size(), bmfont)) {
+		return true;
+	}
+	bmfont = bmf_font{};
+	return read_file(path, data) && load_bmfont(data.data(), data.size(), bmfont);
+}
+
+inline void save_bmfont_binary(const bmf_font& bmfont, std::vector<unsigned char>& out) {
+	using bmf_detail::write_le;
+
+	out.clear();
+	out.insert(out.end(), { 'B', 'M', 'F', 3 });
+
+	auto begin_block = [&out](std::uint8_t type) {
+		out.push_back(type);
+		write_le<std::uint32_t>(out, 0);
+		return out.size();
+	};
+	auto end_block = [&out](std::size_t begin) {
+		auto size = static_cast<std::uint32_t>(out.size() - begin);
+		for (std::size_t i = 0; i < 4; ++i) out[begin - 4 + i] = static_cast<unsigned char>(size >> (8 * i));
+	};
+
+	{
+		auto& info = bmfont.info;
+		auto begin = begin_block(1);
+		write_le<std::int16_t>(out, static_cast<std::int16_t>(info.size));
+		out.push_back(static_cast<unsigned char>((info.smooth << 7) | (info.unicode << 6) | (info.italic << 5) | (info.bold << 4)));
+		out.push_back(static_cast<unsigned char>(info.unicode ? 0 : bmf_detail::to_int(info.charset)));
+		write_le<std::uint16_t>(out, static_cast<std::uint16_t>(info.stretchH));
+		out.push_back(info.aa ? 1 : 0);
+		out.insert(out.end(), {
+			static_cast<unsigned char>(info.padding.up),
+			static_cast<unsigned char>(info.padding.right),
+			static_cast<unsigned char>(info.padding.down),
+			static_cast<unsigned char>(info.padding.left),
+			static_cast<unsigned char>(info.spacing.horizontal),
+			static_cast<unsigned char>(info.spacing.vertical),
+			static_cast<unsigned char>(info.outline),
+		});
+		out.insert(out.end(), info.face.begin(), info.face.end());
+		out.push_back(0);
+		end_block(begin);
+	}
+	{
+		auto& common = bmfont.common;
+		auto begin = begin_block(2);
+		write_le<std::uint16_t>(out, static_cast<std::uint16_t>(common.line_height));
+		write_le<std::uint16_t>(out, static_cast<std::uint16_t>(common.base));
+		write_le<std::uint16_t>(out, static_cast<std::uint16_t>(common.scale_width));
+		write_le<std::uint16_t>(out, static_cast<std::uint16_t>(common.scale_height));
+		write_le<std::uint16_t>(out, static_cast<std::uint16_t>(common.pages));
+		out.push_back(common.packed ? 0x01 : 0);
+		out.insert(out.end(), {
+			static_cast<unsigned char>(common.alpha_channel),
+			static_cast<unsigned char>(common.red_channel),
+			static_cast<unsigned char>(common.green_channel),
+			static_cast<unsigned char>(common.blue_channel),
+		});
+		end_block(begin);
+	}
+	{
+		auto begin = begin_block(3);
+		for (auto& page : bmfont.pages) {
+			out.insert(out.end(), page.file.begin(), page.file.end());
+			out.push_back(0);
+		}
+		end_block(begin);
+	}
+	{
+		auto begin = begin_block(4);
+		for (auto& c : bmfont.chars) {
+			write_le<std::uint32_t>(out, c.id);
+			write_le<std::uint16_t>(out, c.x);
+			write_le<std::uint16_t>(out, c.y);
+			write_le<std::uint16_t>(out, c.width);
+			write_le<std::uint16_t>(out, c.height);
+			write_le<std::int16_t>(out, c.x_offset);
+			write_le<std::int16_t>(out, c.y_offset);
+			write_le<std::int16_t>(out, c.x_advance);
+			out.push_back(c.page);
+			out.push_back(c.channel);
+		}
+		end_block(begin);
+	}
+}
+
+#endif // BMFONT_HPP_
@@ -0,0 +1,100 @@
+﻿#ifndef CELL_DIFF_HPP_
+#define CELL_DIFF_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define CELL_DIFF_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CELL_DIFF_SSE2 1
+#endif
+
+/**
+*  Changed cells [begin, end) of one row.
+*/
+struct cell_span {
+	int row;
+	int begin;
+	int end;
+};
+
+namespace cell_diff_detail {
+
+// 16 バイトのセル 4 つを比較し、変化したセルのビットを立てて返す
+inline unsigned int changed4(const unsigned char* a, const unsigned char* b) {
+#if defined(CELL_DIFF_AVX2)
+	const __m256i eq0 = _mm256_cmpeq_epi8(
+		_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a)),
+		_mm256_loadu_si256(reinterpret_cast<const __m256i*>(b)));
+	const __m256i eq1 = _mm256_cmpeq_epi8(
+		_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + 32)),
+		_mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + 32)));
+	if (_mm256_testc_si256(_mm256_and_si256(eq0, eq1), _mm256_set1_epi8(-1))) return 0;
+	const std::uint32_t m0 = static_cast<std::uint32_t>(_mm256_movemask_epi8(eq0));
+	const std::uint32_t m1 = static_cast<std::uint32_t>(_mm256_movemask_epi8(eq1));
+	return ((m0 & 0xFFFF) != 0xFFFF ? 1u : 0u)
+		| ((m0 >> 16) != 0xFFFF ? 2u : 0u)
+		| ((m1 & 0xFFFF) != 0xFFFF ? 4u : 0u)
+		| ((m1 >> 16) != 0xFFFF ? 8u : 0u);
+#elif defined(CELL_DIFF_SSE2)
+	unsigned int mask = 0;
+	for (int i = 0; i < 4; ++i) {
+		const __m128i eq = _mm_cmpeq_epi8(
+			_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i * 16)),
+			_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i * 16)));
+		if (_mm_movemask_epi8(eq) != 0xFFFF) mask |= 1u << i;
+	}
+	return mask;
+#else
+	unsigned int mask = 0;
+	for (int i = 0; i < 4; ++i) {
+		if (std::memcmp(a + i * 16, b + i * 16, 16) != 0) mask |= 1u << i;
+	}
+	return mask;
+#endif
+}
+
+} // namespace cell_diff_detail
+
+/**
+*  Append the runs of cells that differ between front and back, row by row.
+*  Cell must be a 16-byte record with no uninitialized padding.
+*/
+template<typename Cell>
+void diff_cells(const Cell* front, const Cell* back, int cols, int rows, std::vector<cell_span>& out) {
+	static_assert(sizeof(Cell) == 16, "diff_cells compares 16-byte cells");
+
+	for (int y = 0; y < rows; ++y) {
+		auto* a = reinterpret_cast<const unsigned char*>(front + std::size_t(y) * cols);
+		auto* b = reinterpret_cast<const unsigned char*>(back + std::size_t(y) * cols);
+		int run = -1;
+		auto step = [&](int x, bool changed) {
+			if (changed) {
+				if (run < 0) run = x;
+
+			} else if (run >= 0) {
+				out.push_back({ y, run, x });
+				run = -1;
+			}
+		};
+
+		int x = 0;
+		for (; x + 4 <= cols; x += 4) {
+			auto mask = cell_diff_detail::changed4(a + x * 16, b + x * 16);
+			if (mask == 0 && run < 0) continue;
+			if (mask == 0xF && run >= 0) continue;
+			for (int i = 0; i < 4; ++i) step(x + i, (mask & (1u << i)) != 0);
+		}
+		for (; x < cols; ++x) {
+			step(x, std::memcmp(a + x * 16, b + x * 16, 16) != 0);
+		}
+		if (run >= 0) out.push_back({ y, run, cols });
+	}
+}
+
+#endif // CELL_DIFF_HPP_
@@ -0,0 +1,117 @@
+﻿#ifndef CODEPOINT_TABLE_HPP_
+#define CODEPOINT_TABLE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+/**
+*  Dense codepoint -> value map.
+*
+*  U+0000..U+00FF are looked up in a flat array, the rest of the BMP goes
+*  through a 256-entry page index where unused pages share one empty page,
+*  and supplementary planes fall back to a sorted vector.
+*/
+template<typename T, T Empty = T{}>
+class codepoint_table {
+public:
+	static constexpr std::size_t page_bits = 8;
+	static constexpr std::size_t page_size = std::size_t(1) << page_bits;
+	static constexpr char32_t bmp_end = 0x10000;
+
+	using value_type = T;
+	using page = std::array<T, page_size>;
+
+	static constexpr T empty = Empty;
+
+	codepoint_table() { clear(); }
+
+	void clear() {
+		_direct.fill(Empty);
+		_index.fill(0);
+		_pages.assign(1, page{});
+		_pages.front().fill(Empty);
+		_extended.clear();
+	}
+
+	inline T find(char32_t codepoint) const {
+		if (codepoint < page_size) {
+			return _direct[codepoint];
+
+		} else if (codepoint < bmp_end) {
+			return _pages[_index[codepoint >> page_bits]][codepoint & (page_size - 1)];
+		}
+		return find_extended(codepoint);
+	}
+
+	inline bool contains(char32_t codepoint) const {
+		return find(codepoint) != Empty;
+	}
+
+	void insert(char32_t codepoint, T value) {
+		if (codepoint < page_size) {
+			_direct[codepoint] = value;
+
+		} else if (codepoint < bmp_end) {
+			auto& index = _index[codepoint >> page_bits];
+			if (index == 0) {
+				index = static_cast<std::uint16_t>(_pages.size());
+				_pages.emplace_back().fill(Empty);
+			}
+			_pages[index][codepoint & (page_size - 1)] = value;
+
+		} else {
+			auto it = std::lower_bound(_extended.begin(), _extended.end(), codepoint, extended_less{});
+			if (it != _extended.end() && it->first == codepoint) {
+				it->second = value;
+
+			} else {
+				_extended.insert(it, { codepoint, value });
+			}
+		}
+	}
+
+	template<typename F>
+	void for_each(F&& f) const {
+		for (std::size_t i = 0; i < page_size; ++i) {
+			if (_direct[i] != Empty) f(static_cast<char32_t>(i), _direct[i]);
+		}
+		for (std::size_t hi = 1; hi < _index.size(); ++hi) {
+			if (auto index = _index[hi]) {
+				auto& p = _pages[index];
+				for (std::size_t lo = 0; lo < page_size; ++lo) {
+					if (p[lo] != Empty) f(static_cast<char32_t>((hi << page_bits) | lo), p[lo]);
+				}
+			}
+		}
+		for (auto& [codepoint, value] : _extended) {
+			f(codepoint, value);
+		}
+	}
+
+	std::size_t memory_usage() const {
+		return sizeof(*this)
+			+ _pages.capacity() * sizeof(page)
+			+ _extended.capacity() * sizeof(_extended.front());
+	}
+
+private:
+	struct extended_less {
+		inline bool operator()(const std::pair<char32_t, T>& lhs, char32_t rhs) const { return lhs.first < rhs; }
+	};
+
+	T find_extended(char32_t codepoint) const {
+		auto it = std::lower_bound(_extended.begin(), _extended.end(), codepoint, extended_less{});
+		return (it != _extended.end() && it->first == codepoint) ? it->second : Empty;
+	}
+
+	std::array<T, page_size> _direct;
+	std::array<std::uint16_t, (bmp_end >> page_bits)> _index;
+	std::vector<page> _pages;
+	std::vector<std::pair<char32_t, T>> _extended;
+};
+
+#endif // CODEPOINT_TABLE_HPP_
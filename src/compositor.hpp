@@ -0,0 +1,234 @@
+﻿#ifndef COMPOSITOR_HPP_
+#define COMPOSITOR_HPP_
+
+#include <SDL.h>
+
+#include <vector>
+#include <algorithm>
+
+#include "util.hpp"
+#include "console.hpp"
+#include "render.hpp"
+#include "alloc_tracker.hpp"
+
+/**
+*  Stacks consoles and static textures by z-order into one cached texture.
+*
+*  Each console keeps rendering into its own texture; the compositor only
+*  copies layers again inside the area that changed since the last compose(),
+*  and skips layers hidden there by an opaque layer above them. A popup over
+*  a static pane therefore costs the popup's redraw plus one copy of the
+*  covered part of the pane.
+*/
+class compositor {
+public:
+	using layer_id = int;
+	static constexpr layer_id layer_none = 0;
+
+	compositor() {}
+
+	// console は remove() するまで生きている必要がある
+	layer_id add(console& target, int z) {
+		auto& l = add_layer(z);
+		l.target = &target;
+		l.opaque = true;
+		return l.id;
+	}
+
+	layer_id add(const SDL_Pointer<SDL_Texture>& texture, const SDL_Rect* src, const SDL_Rect& dst, int z, bool opaque = true) {
+		auto& l = add_layer(z);
+		l.texture = texture;
+		l.has_src = (src != nullptr);
+		if (src) l.src = *src;
+		l.rect = dst;
+		l.opaque = opaque;
+		return l.id;
+	}
+
+	void remove(layer_id id) {
+		auto it = std::find_if(_layers.begin(), _layers.end(), [id](auto& l) { return l.id == id; });
+		if (it == _layers.end()) return;
+		if (it->drawn) damage(it->drawn_rect);
+		_layers.erase(it);
+	}
+
+	void z_order(layer_id id, int z) {
+		if (auto* l = find(id); l && l->z != z) {
+			l->z = z;
+			l->dirty = true;
+			sort();
+		}
+	}
+
+	void visible(layer_id id, bool enable) {
+		if (auto* l = find(id)) l->visible = enable;
+	}
+
+	// テクスチャレイヤーの表示先 (console は自身の位置と拡大率を使う)
+	void rect(layer_id id, const SDL_Rect& dst) {
+		if (auto* l = find(id)) l->rect = dst;
+	}
+
+	// テクスチャレイヤーの中身を書き換えたときに呼ぶ
+	void invalidate(layer_id id) {
+		if (auto* l = find(id)) l->dirty = true;
+	}
+
+	inline void invalidate() { _full = true; }
+
+	inline void bg_color(const SDL_Color& color) {
+		_bg_color = color;
+		invalidate();
+	}
+
+	/**
+	*  Bring every console layer's texture up to date and recompose the
+	*  changed area of the output, which is created or resized to w x h.
+	*  Only consoles with pending cell changes are flushed here; one that is
+	*  also drawn to immediately must be begun, flushed and finished by the
+	*  caller before compose(), or its begin() would erase that drawing.
+	*/
+	void compose(SDL_Renderer* renderer, int w, int h) {
+		ALLOC_SCOPE("compositor::compose");
+		PROFILE_ZONE("compositor::compose");
+		if (int tex_w = 0, tex_h = 0; !_buffer || SDL_QueryTexture(tex(), nullptr, nullptr, &tex_w, &tex_h) != 0 || tex_w != w || tex_h != h) {
+			_buffer = make_texture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, w, h);
+			_full = true;
+		}
+		if (!_buffer) return;
+
+		for (auto& l : _layers) {
+			if (l.target) {
+				if (l.target->dirty()) {
+					l.target->begin(renderer);
+					l.target->flush(renderer);
+					l.target->finish(renderer);
+				}
+				l.rect = l.target->screen_rect();
+				if (l.revision != l.target->revision()) {
+					l.revision = l.target->revision();
+					l.dirty = true;
+				}
+			}
+
+			const bool shown = l.visible && source(l) != nullptr && l.rect.w > 0 && l.rect.h > 0;
+			if (shown != l.drawn || (shown && (l.dirty || !same_rect(l.rect, l.drawn_rect)))) {
+				if (l.drawn) damage(l.drawn_rect);
+				if (shown) damage(l.rect);
+			}
+			l.drawn = shown;
+			l.drawn_rect = l.rect;
+			l.dirty = false;
+		}
+
+		if (_full) {
+			_damage = { 0, 0, w, h };
+			_full = false;
+		}
+		if (_damage.w <= 0 || _damage.h <= 0) return;
+
+		auto* before_target = SDL_GetRenderTarget(renderer);
+		render::target(renderer, tex());
+		render::clip_rect(renderer, &_damage);
+		render::draw_color(renderer, _bg_color.r, _bg_color.g, _bg_color.b, 0xFF);
+		render::fill_rect(renderer, &_damage);
+
+		for (std::size_t i = 0; i < _layers.size(); ++i) {
+			auto& l = _layers[i];
+			SDL_Rect area{};
+			if (!l.drawn || !SDL_IntersectRect(&l.rect, &_damage, &area)) continue;
+			if (occluded(i, area)) continue;
+			render::copy(renderer, source(l), l.has_src ? &l.src : nullptr, &l.rect);
+		}
+
+		render::clip_rect(renderer, nullptr);
+		render::target(renderer, before_target);
+		_damage = {};
+	}
+
+	inline void present(SDL_Renderer* renderer, const SDL_Rect* dst = nullptr) {
+		if (_buffer) render::copy(renderer, tex(), nullptr, dst);
+	}
+
+	inline SDL_Texture* tex() const { return _buffer.get(); }
+
+private:
+	struct layer {
+		layer_id id = layer_none;
+		int z = 0;
+		console* target = nullptr;
+		SDL_Pointer<SDL_Texture> texture;
+		SDL_Rect src{};
+		bool has_src = false;
+		SDL_Rect rect{};
+		bool opaque = true;
+		bool visible = true;
+		bool dirty = true;
+
+		// 前回合成したときの状態
+		unsigned revision = 0;
+		bool drawn = false;
+		SDL_Rect drawn_rect{};
+	};
+
+	layer& add_layer(int z) {
+		auto& l = _layers.emplace_back();
+		l.id = ++_last_id;
+		l.z = z;
+		sort();
+		return *find(_last_id);
+	}
+
+	layer* find(layer_id id) {
+		for (auto& l : _layers) {
+			if (l.id == id) return &l;
+		}
+		return nullptr;
+	}
+
+	void sort() {
+		std::stable_sort(_layers.begin(), _layers.end(), [](auto& a, auto& b) { return a.z < b.z; });
+	}
+
+	static SDL_Texture* source(const layer& l) {
+		return l.target ? l.target->tex() : l.texture.get();
+	}
+
+	// area が上にある不透明なレイヤー 1 枚で覆われているか
+	bool occluded(std::size_t index, const SDL_Rect& area) const {
+		for (std::size_t i = index + 1; i < _layers.size(); ++i) {
+			auto& l = _layers[i];
+			if (!l.drawn || !l.opaque) continue;
+			if (l.rect.x <= area.x && l.rect.y <= area.y
+				&& l.rect.x + l.rect.w >= area.x + area.w
+				&& l.rect.y + l.rect.h >= area.y + area.h) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void damage(const SDL_Rect& rect) {
+		if (rect.w <= 0 || rect.h <= 0) return;
+		if (_damage.w <= 0 || _damage.h <= 0) {
+			_damage = rect;
+
+		} else {
+			SDL_UnionRect(&_damage, &rect, &_damage);
+		}
+	}
+
+	static inline bool same_rect(const SDL_Rect& a, const SDL_Rect& b) {
+		return a.x == b.x && a.y == b.y && a.w == b.w && a.h == b.h;
+	}
+
+	std::vector<layer> _layers;
+	layer_id _last_id = layer_none;
+
+	SDL_Pointer<SDL_Texture> _buffer;
+	SDL_Color _bg_color{ 0x80, 0x80, 0x80, 0xFF };
+	SDL_Rect _damage{};
+	bool _full = true;
+};
+
+#endif // COMPOSITOR_HPP_
@@ -8,11 +8,19 @@
 #include <vector>
 #include <string>
 #include <optional>
-
-#include <tinyutf8.h>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <string_view>
 
 #include "util.hpp"
 #include "font.hpp"
+#include "cell_diff.hpp"
+#include "grid_renderer.hpp"
+#include "render.hpp"
+#include "utf8.hpp"
+#include "alloc_tracker.hpp"
+#include "profiler.hpp"
 
 class cursor {
 public:
@@ -61,9 +69,26 @@ private:
 	SDL_Rect _rect{};
 };
 
+struct console_cell {
+	enum attribute : std::uint8_t {
+		none = 0,
+		fill_bg = 1 << 0,
+	};
+
+	char32_t codepoint;
+	SDL_Color fg;
+	SDL_Color bg;
+	std::uint8_t attr;
+	std::uint8_t reserved[3];
+};
+static_assert(sizeof(console_cell) == 16, "console_cell should stay 16 bytes");
+
 class console {
 public:
-	console() {}
+	console() {
+		_cursor.size(_cell.w, _cell.h);
+		resize_cells();
+	}
 
 	enum option {
 		none = 0,
@@ -75,7 +100,34 @@ public:
 		return _font_ptr.lock();
 	}
 
-	void print(SDL_Renderer* renderer, const tiny_utf8::utf8_string &string, option opt = option::none) {
+	inline void print(SDL_Renderer* renderer, std::string_view string, option opt = option::none) {
+		print_codepoints(renderer, utf8::codepoints(string), opt);
+	}
+
+	inline void print(SDL_Renderer* renderer, std::u32string_view string, option opt = option::none) {
+		print_codepoints(renderer, string, opt);
+	}
+
+	inline void print(SDL_Renderer* renderer, std::string_view string, int x, int y, option opt = option::none) {
+		print_codepoints(renderer, utf8::codepoints(string), x, y, opt);
+	}
+
+	inline void print(SDL_Renderer* renderer, std::u32string_view string, int x, int y, option opt = option::none) {
+		print_codepoints(renderer, string, x, y, opt);
+	}
+
+	inline void print(SDL_Renderer* renderer, std::string_view string, const SDL_Rect& rect, option opt = option::none) {
+		print_codepoints(renderer, utf8::codepoints(string), rect, opt);
+	}
+
+	inline void print(SDL_Renderer* renderer, std::u32string_view string, const SDL_Rect& rect, option opt = option::none) {
+		print_codepoints(renderer, string, rect, opt);
+	}
+
+	template<typename Codepoints>
+	void print_codepoints(SDL_Renderer* renderer, const Codepoints& codepoints, option opt = option::none) {
+		ALLOC_SCOPE("console::print");
+		PROFILE_ZONE("console::print");
 		auto p = current_font();
 		if (!p) return;
 
@@ -83,7 +135,7 @@ public:
 		bool fill_cell_bg = ((opt & option::fill_cell_bg) != 0);
 		auto& put_color = inverse ? _bg_color : _fg_color;
 
-		for (char32_t codepoint : string) {
+		for (char32_t codepoint : codepoints) {
 			if (codepoint == '\n') {
 				next_line();
 
@@ -95,21 +147,29 @@ public:
 					break;
 				}
 
-				if (fill_cell_bg || inverse) fill_cell(renderer, inverse);
+				if (fill_cell_bg || inverse) _fills.add(_cursor.rect(), inverse ? _fg_color : _bg_color);
 				p->put_char(renderer, _cursor.x(), _cursor.y(), codepoint, &put_color);
+				mark_dirty_pixels(_cursor.rect());
 				_cursor.advance();
 			}
 		}
+		// 後の print の背景が先に描かれて文字を隠さないよう、文字もここで描く
+		_fills.flush(renderer);
+		p->flush(renderer);
 	}
 
-	void print(SDL_Renderer* renderer, const tiny_utf8::utf8_string& string, int x, int y, option opt = option::none) {
+	template<typename Codepoints>
+	void print_codepoints(SDL_Renderer* renderer, const Codepoints& codepoints, int x, int y, option opt = option::none) {
 		SDL_Rect render_rect = _size;
 		render_rect.x += x;
 		render_rect.y += y;
-		print(renderer, string, render_rect, opt);
+		print_codepoints(renderer, codepoints, render_rect, opt);
 	}
 
-	void print(SDL_Renderer* renderer, const tiny_utf8::utf8_string& string, const SDL_Rect &rect, option opt = option::none) {
+	template<typename Codepoints>
+	void print_codepoints(SDL_Renderer* renderer, const Codepoints& codepoints, const SDL_Rect &rect, option opt = option::none) {
+		ALLOC_SCOPE("console::print");
+		PROFILE_ZONE("console::print");
 		auto p = current_font();
 		if (!p) return;
 
@@ -141,7 +201,7 @@ public:
 
 		if ((local_cursor.x() + local_cursor.w()) > render_right) return;
 
-		for (char32_t codepoint : string) {
+		for (char32_t codepoint : codepoints) {
 			if (codepoint == '\n') {
 				local_cursor.next_line(render_rect.x);
 
@@ -154,30 +214,32 @@ public:
 				}
 
 				if (fill_cell_bg || inverse) {
-					fill_cell(renderer, { local_cursor.x(), local_cursor.y(), local_cursor.w(), local_cursor.h() }, inverse);
+					_fills.add(local_cursor.rect(), inverse ? _fg_color : _bg_color);
 				}
-				p->put_char(renderer, local_cursor.x(), local_cursor.y(), codepoint, &_fg_color);
+				p->put_char(renderer, local_cursor.x(), local_cursor.y(), codepoint, &put_color);
+				mark_dirty_pixels(local_cursor.rect());
 				local_cursor.advance();
 			}
 		}
+		// 後の print の背景が先に描かれて文字を隠さないよう、文字もここで描く
+		_fills.flush(renderer);
+		p->flush(renderer);
 	}
 
 	void fill(SDL_Renderer *renderer, bool inverse = false) {
-		auto& color = inverse ? _fg_color : _bg_color;
-		SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, 0xFF);
-		SDL_RenderFillRect(renderer, &_size);
+		if (auto p = current_font()) p->flush(renderer);
+		fill_rect(renderer, _size, inverse ? _fg_color : _bg_color);
+		invalidate();
 	}
 
 	void fill_cell(SDL_Renderer* renderer, bool inverse = false) {
-		auto& color = inverse ? _fg_color : _bg_color;
-		SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, 0xFF);
-		SDL_RenderFillRect(renderer, &_cursor.rect());
+		fill_cell(renderer, _cursor.rect(), inverse);
 	}
 
 	void fill_cell(SDL_Renderer* renderer, const SDL_Rect& rect, bool inverse = false) {
-		auto& color = inverse ? _fg_color : _bg_color;
-		SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, 0xFF);
-		SDL_RenderFillRect(renderer, &rect);
+		if (auto p = current_font()) p->flush(renderer);
+		fill_rect(renderer, rect, inverse ? _fg_color : _bg_color);
+		mark_dirty_pixels(rect);
 	}
 
 	inline void current_font(const std::shared_ptr<font_set> &font_ptr) {
@@ -185,24 +247,37 @@ public:
 	}
 
 	inline void pos(int x, int y) { _rect.x = x; _rect.y = y; }
-	inline void cell(int w, int h) { _cell.w = w; _cell.h = h; _cursor.size(w, h); }
-	inline void size(int w, int h) { _rect.w = _size.w = w; _rect.h = _size.h = h; }
+	inline void cell(int w, int h) { _cell.w = w; _cell.h = h; _cursor.size(w, h); resize_cells(); }
+	inline void size(int w, int h) { _rect.w = _size.w = w; _rect.h = _size.h = h; resize_cells(); }
 	inline void geom(int cols, int rows) { size(_cell.w * cols, _cell.h * rows); }
 
 	inline void scale(int s) { _scale = s; }
 	inline auto scale() const { return _scale; }
 
 	inline void fg_color(const SDL_Color& color) { _fg_color = color; }
-	inline void bg_color(const SDL_Color &color) { _bg_color = color; }
+	inline const SDL_Color& fg_color() const { return _fg_color; }
+	inline void bg_color(const SDL_Color &color) {
+		if (color.r != _bg_color.r || color.g != _bg_color.g || color.b != _bg_color.b) invalidate();
+		_bg_color = color;
+	}
+	inline const SDL_Color& bg_color() const { return _bg_color; }
 
 	inline const SDL_Rect &rect() const { return _rect; }
 	inline const SDL_Rect& cell() const { return _cell; }
 
+	// 拡大を含めた、描画先での矩形
+	inline SDL_Rect screen_rect() const {
+		return (scale() <= 1) ? _rect : SDL_Rect{ x(), y(), w() * scale(), h() * scale() };
+	}
+
 	inline int x() const { return _rect.x; }
 	inline int y() const { return _rect.y; }
 	inline int w() const { return _size.w; }
 	inline int h() const { return _size.h; }
 
+	inline int cols() const { return _cols; }
+	inline int rows() const { return _rows; }
+
 	inline int left() const { return _rect.x; }
 	inline int top() const { return _rect.y; }
 	inline int right() const { return _rect.x + _rect.w; }
@@ -219,60 +294,298 @@ public:
 	inline void lf() { _cursor.advance_y(); }
 	inline void next_line() { cr(); lf(); }
 
-	inline void print(const tiny_utf8::utf8_string &string, const SDL_Rect &rect, option opt = option::none) {
-		_entries.push_back({ SDL_Rect{ rect.x * _cell.w, rect.y * _cell.h, rect.w * _cell.w, rect.h * _cell.h }, string, opt });
+	// rect はセル単位、カーソルは動かさない
+	inline void print(std::string_view string, const SDL_Rect& rect, option opt = option::none) {
+		print_codepoints(utf8::codepoints(string), rect, opt);
+	}
+
+	inline void print(std::u32string_view string, const SDL_Rect& rect, option opt = option::none) {
+		print_codepoints(string, rect, opt);
+	}
+
+	inline void print(std::string_view string, int x, int y, option opt = option::none) {
+		coord(x, y);
+		print_codepoints(utf8::codepoints(string), opt);
+	}
+
+	inline void print(std::u32string_view string, int x, int y, option opt = option::none) {
+		coord(x, y);
+		print_codepoints(string, opt);
+	}
+
+	inline void print(std::string_view string, option opt = option::none) {
+		print_codepoints(utf8::codepoints(string), opt);
+	}
+
+	inline void print(std::u32string_view string, option opt = option::none) {
+		print_codepoints(string, opt);
+	}
+
+	template<typename Codepoints>
+	void print_codepoints(const Codepoints& codepoints, const SDL_Rect &rect, option opt = option::none) {
+		ALLOC_SCOPE("console::print");
+		const int left = std::max(rect.x, 0);
+		const int right = std::min(rect.x + rect.w, _cols);
+		const int bottom = std::min(rect.y + rect.h, _rows);
+		if (left >= right) return;
+
+		int x = left, y = rect.y;
+		for (char32_t codepoint : codepoints) {
+			if (codepoint == '\n') {
+				x = left;
+				++y;
+
+			} else {
+				if (x >= right) {
+					x = left;
+					++y;
+				}
+				if (y >= bottom) {
+					break;
+				}
+
+				put(x, y, codepoint, opt);
+				++x;
+			}
+		}
+	}
+
+	template<typename Codepoints>
+	void print_codepoints(const Codepoints& codepoints, option opt = option::none) {
+		ALLOC_SCOPE("console::print");
+		// セルの大きさが 0 ならカーソルの位置からセルを求められない
+		if (_cols <= 0 || _rows <= 0) return;
+		for (char32_t codepoint : codepoints) {
+			if (codepoint == '\n') {
+				next_line();
+
+			} else {
+				if (_cursor.coord_x() >= _cols) {
+					next_line();
+				}
+				if (_cursor.coord_y() >= _rows) {
+					break;
+				}
+
+				put(_cursor.coord_x(), _cursor.coord_y(), codepoint, opt);
+				_cursor.advance();
+			}
+		}
 	}
 
-	inline void print(const tiny_utf8::utf8_string& string, int x, int y, option opt = option::none) {
-		_entries.push_back({ SDL_Rect{ x, y, -1, -1 }, string, opt });
+	void put(int x, int y, char32_t codepoint, option opt = option::none) {
+		if (x < 0 || y < 0 || x >= _cols || y >= _rows) return;
+
+		bool inverse = ((opt & option::inverse) != 0);
+		bool fill_cell_bg = ((opt & option::fill_cell_bg) != 0);
+
+		console_cell c{};
+		c.codepoint = codepoint;
+		c.fg = inverse ? _bg_color : _fg_color;
+		c.bg = inverse ? _fg_color : _bg_color;
+		c.attr = (inverse || fill_cell_bg) ? console_cell::fill_bg : console_cell::none;
+		put(x, y, c);
 	}
 
-	inline void print(const tiny_utf8::utf8_string& string, option opt = option::none) {
-		_entries.push_back({ SDL_Rect{ -1, -1, -1, -1 }, string, opt });
+	void put(int x, int y, const console_cell& c) {
+		if (x < 0 || y < 0 || x >= _cols || y >= _rows) return;
+
+		auto& target = _cells[y * _cols + x];
+		if (std::memcmp(&target, &c, sizeof(c)) != 0) {
+			target = c;
+			touch(x, y);
+		}
 	}
 
+	/**
+	*  Move the cells inside area (in cells) up by lines, or down when lines
+	*  is negative, leaving blank cells in the exposed rows.
+	*
+	*  The texture is shifted with a copy on the next flush(), so only the
+	*  exposed rows are drawn again. If the area already has pending changes
+	*  or text drawn immediately, the whole area is redrawn instead.
+	*/
+	void scroll(const SDL_Rect& area, int lines) {
+		const int x0 = std::max(area.x, 0), x1 = std::min(area.x + area.w, _cols);
+		const int y0 = std::max(area.y, 0), y1 = std::min(area.y + area.h, _rows);
+		if (lines == 0 || x0 >= x1 || y0 >= y1) return;
+
+		const SDL_Rect clipped{ x0, y0, x1 - x0, y1 - y0 };
+		const int count = std::min(std::abs(lines), clipped.h);
+		const int keep = clipped.h - count;
+		auto move_rows = [&](std::vector<console_cell>& cells) {
+			for (int i = 0; i < keep; ++i) {
+				const int dst = (lines > 0) ? (y0 + i) : (y1 - 1 - i);
+				const int src = (lines > 0) ? (dst + count) : (dst - count);
+				std::copy(&cells[src * _cols + x0], &cells[src * _cols + x1], &cells[dst * _cols + x0]);
+			}
+		};
+		move_rows(_cells);
+		const int exposed_y = (lines > 0) ? (y1 - count) : y0;
+		for (int row = exposed_y; row < exposed_y + count; ++row) {
+			std::fill(&_cells[row * _cols + x0], &_cells[row * _cols + x1], console_cell{});
+		}
+
+		const bool pending = dirty() && SDL_HasIntersection(&_dirty, &clipped);
+		// 即時描画した文字もずれて写るが、begin() は元の位置しか消さないので全体を描き直す
+		const bool overlay = _overlay.w > 0 && _overlay.h > 0 && SDL_HasIntersection(&_overlay, &clipped);
+		if (keep == 0 || pending || overlay || _scroll_lines != 0) {
+			mark_dirty(clipped.x, clipped.y, clipped.w, clipped.h);
+			return;
+		}
+
+		// 表側も同じだけずらしておけば、差分に出るのは露出した行だけになる
+		if (_diff_mode) move_rows(_front);
+		_scroll_area = clipped;
+		_scroll_lines = (lines > 0) ? count : -count;
+		mark_dirty(clipped.x, exposed_y, clipped.w, count);
+	}
+
+	inline const console_cell& cell_at(int x, int y) const { return _cells[y * _cols + x]; }
+
 	inline void cls() {
-		_entries.clear();
+		std::fill(_cells.begin(), _cells.end(), console_cell{});
+		touch(0, 0, _cols, _rows);
+		coord();
+	}
+
+	// セル単位の範囲を、内容に関係なく次の flush で描き直す
+	void mark_dirty(int x, int y, int w = 1, int h = 1) {
+		touch(x, y, w, h);
+		if (_diff_mode) {
+			// 表側をあり得ない値で潰して、差分に必ず出るようにする
+			const int x0 = std::max(x, 0), x1 = std::min(x + w, _cols);
+			for (int row = std::max(y, 0); row < std::min(y + h, _rows) && x0 < x1; ++row) {
+				std::memset(&_front[row * _cols + x0], 0xFF, sizeof(console_cell) * (x1 - x0));
+			}
+		}
+	}
+
+	/**
+	*  Erase an immediately drawn pixel area (plus one cell of overhang) at
+	*  the next frame's begin(), so flushes later in the same frame (e.g. by
+	*  a compositor) don't wipe it before it is shown.
+	*/
+	void mark_dirty_pixels(const SDL_Rect& rect) {
+		++_revision;
+		if (_cell.w <= 0 || _cell.h <= 0) return;
+		int x0 = rect.x / _cell.w - 1;
+		int y0 = rect.y / _cell.h - 1;
+		int x1 = (rect.x + rect.w + _cell.w - 1) / _cell.w + 1;
+		int y1 = (rect.y + rect.h + _cell.h - 1) / _cell.h + 1;
+		if (_overlay.w > 0 && _overlay.h > 0) {
+			x0 = std::min(x0, _overlay.x);
+			y0 = std::min(y0, _overlay.y);
+			x1 = std::max(x1, _overlay.x + _overlay.w);
+			y1 = std::max(y1, _overlay.y + _overlay.h);
+		}
+		_overlay = { x0, y0, x1 - x0, y1 - y0 };
+	}
+
+	// テクスチャの内容が失われたとき (SDL_RENDER_TARGETS_RESET など) にも呼ぶ
+	inline void invalidate() {
+		_scroll_lines = 0;
+		mark_dirty(0, 0, _cols, _rows);
+	}
+
+	inline bool dirty() const { return _dirty.w > 0 && _dirty.h > 0; }
+
+	/**
+	*  Diff mode keeps the last drawn cells (front) next to the written ones
+	*  (back), and flush() redraws only the cells that actually differ, e.g.
+	*  when a whole menu is cleared and reprinted but only the highlight moved.
+	*/
+	inline void diff_mode(bool enable) {
+		if (enable && !_diff_mode) {
+			_front = _cells;
+			_diff_mode = true;
+			invalidate();
+
+		} else if (!enable) {
+			_front.clear();
+			_front.shrink_to_fit();
+			_diff_mode = false;
+		}
+	}
+	inline bool diff_mode() const { return _diff_mode; }
+
+	/**
+	*  Changed cell runs between what was last drawn and the current cells.
+	*  Valid until the next flush(); only meaningful in diff mode.
+	*/
+	const std::vector<cell_span>& diff() {
+		_spans.clear();
+		if (_diff_mode) diff_cells(_front.data(), _cells.data(), _cols, _rows, _spans);
+		return _spans;
 	}
 
 	inline void begin(SDL_Renderer* renderer) {
-		if (!_buffer) {
+		if (int tex_w = 0, tex_h = 0; !_buffer || SDL_QueryTexture(tex(), nullptr, nullptr, &tex_w, &tex_h) != 0 || tex_w != w() || tex_h != h()) {
 			_buffer = make_texture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, w(), h());
+			invalidate();
 		}
 		if (_before_tex.has_value()) return;
 		_before_tex = SDL_GetRenderTarget(renderer);
-		SDL_SetRenderTarget(renderer, tex());
+		render::target(renderer, tex());
+
+		// 前のフレームで即時描画した範囲をここで消す
+		if (_overlay.w > 0 && _overlay.h > 0) {
+			mark_dirty(_overlay.x, _overlay.y, _overlay.w, _overlay.h);
+			_overlay = {};
+		}
 	}
 
 	inline void end(SDL_Renderer* renderer) {
 		if (!_before_tex.has_value()) return;
-		SDL_SetRenderTarget(renderer, _before_tex.value_or(nullptr));
-		if (scale() <= 1) {
-			SDL_RenderCopy(renderer, tex(), NULL, &_rect);
+		finish(renderer);
+		SDL_Rect dst = screen_rect();
+		render::copy(renderer, tex(), NULL, &dst);
+	}
 
-		} else {
-			SDL_Rect scaled{ x(), y(), w() * scale(), h() * scale() };
-			SDL_RenderCopy(renderer, tex(), NULL, &scaled);
-		}
+	// テクスチャへの描画を終えて元の描画先に戻す (転送はしない)
+	inline void finish(SDL_Renderer* renderer) {
+		if (!_before_tex.has_value()) return;
+		if (auto p = current_font()) p->flush(renderer);
+		render::target(renderer, _before_tex.value_or(nullptr));
 		_before_tex.reset();
 	}
 
+	/**
+	*  Incremented whenever the texture content changes, so a compositor can
+	*  tell whether it has to copy this console again.
+	*/
+	inline unsigned revision() const { return _revision; }
+
+	// 変化したセルだけをテクスチャに描き直す
 	inline void flush(SDL_Renderer* renderer) {
+		ALLOC_SCOPE("console::flush");
+		PROFILE_ZONE("console::flush");
 		begin(renderer);
-		coord();
-		fill(renderer);
-		for (const auto &entry : _entries) {
-			if (entry.rect.x < 0) {
-				print(renderer, entry.str, entry.opt);
+		if (!dirty()) return;
 
-			} else if (entry.rect.w < 0) {
-				coord(entry.rect.x, entry.rect.y);
-				print(renderer, entry.str, entry.opt);
+		auto p = current_font();
+		if (auto* atlas = p ? p->atlas() : nullptr) {
+			// 頂点はどのみち全部描くので、ずらした範囲の頂点を書き直すだけ
+			if (_scroll_lines != 0) {
+				touch(_scroll_area.x, _scroll_area.y, _scroll_area.w, _scroll_area.h);
+				if (_diff_mode) mark_dirty(_scroll_area.x, _scroll_area.y, _scroll_area.w, _scroll_area.h);
+				_scroll_lines = 0;
+			}
+			draw_grid(renderer, p.get(), atlas);
 
-			} else {
-				print(renderer, entry.str, entry.rect, entry.opt);
+		} else if (_diff_mode) {
+			scroll_texture(renderer);
+			for (auto& span : diff()) {
+				redraw(renderer, p.get(), { span.begin, span.row, span.end - span.begin, 1 });
+				std::copy(&_cells[span.row * _cols + span.begin], &_cells[span.row * _cols + span.end], &_front[span.row * _cols + span.begin]);
 			}
+
+		} else {
+			scroll_texture(renderer);
+			redraw(renderer, p.get(), _dirty);
 		}
+		_dirty = {};
+		++_revision;
 	}
 
 	inline SDL_Texture* tex() const { return _buffer.get(); }
@@ -280,16 +593,147 @@ public:
 protected:
 	template<typename... Args>
 	inline auto put_char(Args&&... args) {
-		if (auto p = font()) {
+		if (auto p = current_font()) {
 			p->put_char(std::forward<Args>(args)...);
 		}
 	}
 
-	struct entry {
-		SDL_Rect rect;
-		tiny_utf8::utf8_string str;
-		option opt;
-	};
+	void resize_cells() {
+		_cols = (_cell.w > 0) ? (_size.w / _cell.w) : 0;
+		_rows = (_cell.h > 0) ? (_size.h / _cell.h) : 0;
+		_cells.assign(std::size_t(_cols) * _rows, console_cell{});
+		if (_diff_mode) _front = _cells;
+		_grid_stale = true;
+		_dirty = {};
+		_overlay = {};
+		invalidate();
+	}
+
+	void touch(int x, int y, int w = 1, int h = 1) {
+		int x0 = std::max(x, 0), y0 = std::max(y, 0);
+		int x1 = std::min(x + w, _cols), y1 = std::min(y + h, _rows);
+		if (x0 >= x1 || y0 >= y1) return;
+		if (dirty()) {
+			x0 = std::min(x0, _dirty.x);
+			y0 = std::min(y0, _dirty.y);
+			x1 = std::max(x1, _dirty.x + _dirty.w);
+			y1 = std::max(y1, _dirty.y + _dirty.h);
+		}
+		_dirty = { x0, y0, x1 - x0, y1 - y0 };
+	}
+
+	// cells (セル単位) を消して描き直す
+	void redraw(SDL_Renderer* renderer, font_set* p, const SDL_Rect& cells) {
+		SDL_Rect clip{ cells.x * _cell.w, cells.y * _cell.h, cells.w * _cell.w, cells.h * _cell.h };
+		render::clip_rect(renderer, &clip);
+		fill_rect(renderer, clip, _bg_color);
+
+		if (p) {
+			// 隣のセルからはみ出したグリフも描き直すため 1 セル広く回してクリップする
+			const int x0 = std::max(cells.x - 1, 0);
+			const int y0 = std::max(cells.y - 1, 0);
+			const int x1 = std::min(cells.x + cells.w + 1, _cols);
+			const int y1 = std::min(cells.y + cells.h + 1, _rows);
+			for (int y = y0; y < y1; ++y) {
+				const console_cell* c = &_cells[y * _cols + x0];
+				for (int x = x0; x < x1; ++x, ++c) {
+					if (c->attr & console_cell::fill_bg) {
+						_fills.add({ x * _cell.w, y * _cell.h, _cell.w, _cell.h }, c->bg);
+					}
+					if (c->codepoint) {
+						p->put_char(renderer, x * _cell.w, y * _cell.h, c->codepoint, &c->fg);
+					}
+				}
+			}
+			_fills.flush(renderer);
+			p->flush(renderer);
+		}
+
+		render::clip_rect(renderer, nullptr);
+	}
+
+	// フォントが 1 枚のアトラスに収まっているときは、変化したセルの頂点だけ書き換えて全体を 1 回で描く
+	void draw_grid(SDL_Renderer* renderer, font_set* p, SDL_Texture* atlas) {
+		if (_grid_stale || _grid.atlas() != atlas || _grid.cols() != _cols || _grid.rows() != _rows) {
+			_grid.resize(_cols, _rows, _cell.w, _cell.h);
+			_grid.atlas(atlas, p->solid_uv());
+			update_grid(p, { 0, 0, _cols, _rows });
+			if (_diff_mode) _front = _cells;
+			_grid_stale = false;
+
+		} else if (_diff_mode) {
+			for (auto& span : diff()) {
+				update_grid(p, { span.begin, span.row, span.end - span.begin, 1 });
+				std::copy(&_cells[span.row * _cols + span.begin], &_cells[span.row * _cols + span.end], &_front[span.row * _cols + span.begin]);
+			}
+
+		} else {
+			update_grid(p, _dirty);
+		}
+
+		// グリッドで覆えない端の余り
+		if (_cols * _cell.w < w() || _rows * _cell.h < h()) {
+			fill_rect(renderer, { 0, 0, w(), h() }, _bg_color);
+		}
+		_grid.draw(renderer);
+	}
+
+	void update_grid(font_set* p, const SDL_Rect& cells) {
+		for (int y = cells.y; y < cells.y + cells.h; ++y) {
+			const console_cell* c = &_cells[y * _cols + cells.x];
+			for (int x = cells.x; x < cells.x + cells.w; ++x, ++c) {
+				_grid.set_background(x, y, (c->attr & console_cell::fill_bg) ? c->bg : _bg_color);
+
+				font* target_font = nullptr;
+				const font_set::character* chara = nullptr;
+				if (c->codepoint && p->find_font(c->codepoint, target_font, chara) && chara->width > 0 && chara->height > 0) {
+					_grid.set_glyph(
+						x, y,
+						{ chara->x, chara->y, chara->width, chara->height },
+						{ chara->x_offset, chara->y_offset, chara->width, chara->height },
+						c->fg
+					);
+
+				} else {
+					_grid.clear_glyph(x, y);
+				}
+			}
+		}
+	}
+
+	// scroll() で保留したぶん、テクスチャの中身を作業用テクスチャ経由でずらす
+	void scroll_texture(SDL_Renderer* renderer) {
+		if (_scroll_lines == 0) return;
+		const int dy = _scroll_lines * _cell.h;
+		_scroll_lines = 0;
+
+		if (int tex_w = 0, tex_h = 0; !_scratch || SDL_QueryTexture(_scratch.get(), nullptr, nullptr, &tex_w, &tex_h) != 0 || tex_w != w() || tex_h != h()) {
+			_scratch = make_texture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, w(), h());
+			if (!_scratch) {
+				touch(_scroll_area.x, _scroll_area.y, _scroll_area.w, _scroll_area.h);
+				return;
+			}
+			SDL_SetTextureBlendMode(_scratch.get(), SDL_BLENDMODE_NONE);
+		}
+
+		const SDL_Rect area{ _scroll_area.x * _cell.w, _scroll_area.y * _cell.h, _scroll_area.w * _cell.w, _scroll_area.h * _cell.h };
+		const SDL_Rect src{ area.x, area.y + std::max(dy, 0), area.w, area.h - std::abs(dy) };
+		const SDL_Rect dst{ area.x, area.y + std::max(-dy, 0), src.w, src.h };
+
+		SDL_BlendMode before_mode;
+		SDL_GetTextureBlendMode(tex(), &before_mode);
+		SDL_SetTextureBlendMode(tex(), SDL_BLENDMODE_NONE);
+		render::target(renderer, _scratch.get());
+		render::copy(renderer, tex(), &src, &src);
+		render::target(renderer, tex());
+		render::copy(renderer, _scratch.get(), &src, &dst);
+		SDL_SetTextureBlendMode(tex(), before_mode);
+	}
+
+	static void fill_rect(SDL_Renderer* renderer, const SDL_Rect& rect, const SDL_Color& color) {
+		render::draw_color(renderer, color.r, color.g, color.b, 0xFF);
+		render::fill_rect(renderer, &rect);
+	}
 
 private:
 	cursor _cursor;
@@ -303,9 +747,27 @@ private:
 	SDL_Color _bg_color{ 0, 0, 0, 0xFF };
 
 	SDL_Pointer<SDL_Texture> _buffer;
+	SDL_Pointer<SDL_Texture> _scratch;
 	std::optional<SDL_Texture*> _before_tex;
+	unsigned _revision = 0;
+
+	std::vector<console_cell> _cells;
+	int _cols = 0;
+	int _rows = 0;
+	SDL_Rect _dirty{};
+	SDL_Rect _overlay{};
+
+	fill_batch _fills;
+
+	bool _diff_mode = false;
+	std::vector<console_cell> _front;
+	std::vector<cell_span> _spans;
+
+	SDL_Rect _scroll_area{};
+	int _scroll_lines = 0;
 
-	std::vector<entry> _entries;
+	grid_renderer _grid;
+	bool _grid_stale = true;
 };
 
 #endif // CONSOLE_HPP_
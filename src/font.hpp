@@ -5,75 +5,31 @@
 
 #include <string>
 #include <vector>
-#include <unordered_map>
 #include <algorithm>
 #include <filesystem>
-
-#include <tinyutf8.h>
-#include <pugixml.hpp>
+#include <cstdint>
+#include <string_view>
 
 #include "SDL_stb_image.hpp"
+#include "asset_loader.hpp"
+#include "bmfont.hpp"
+#include "glyph_batch.hpp"
+#include "render.hpp"
+#include "utf8.hpp"
+#include "alloc_tracker.hpp"
+#include "profiler.hpp"
 
-struct bmf_font {
-	struct bmf_info {
-		std::string face;
-		int size = 0;
-		bool bold = false;
-		bool italic = false;
-		std::string charset;
-		bool unicode = false;
-		float stretchH = 100.f;
-		bool smooth = false;
-		bool aa = false;
-		struct bmf_padding {
-			int up, right, down, left;
-		} padding{ 0 };
-		struct bmf_spacing {
-			int horizontal, vertical;
-		} spacing{ 0 };
-		int outline = 0;
-	} info;
-	struct bmf_common {
-		int line_height;
-		int base;
-		int scale_width;
-		int scale_height;
-		int pages;
-		bool packed;
-		enum bmf_channel {
-			glyph = 0,
-			outline,
-			encoded_glyph_and_outline,
-			zero,
-			one,
-		};
-		bmf_channel alpha_channel;
-		bmf_channel red_channel;
-		bmf_channel green_channel;
-		bmf_channel blue_channel;
-	} common;
-	struct bmf_page {
-		int id;
-		std::string file;
-	};
-	std::vector<bmf_page> pages;
-	struct bmf_char {
-		char32_t id;
-		int x, y;
-		int width, height;
-		int x_offset, y_offset;
-		int x_advance;
-		int page;
-		enum bmf_texture_channel {
-			blue = 1 << 0,
-			green = 1 << 1,
-			red = 1 << 2,
-			alpha = 1 << 3,
-		};
-		int channel;
-	};
-	std::unordered_map<char32_t, bmf_char> chars;
-};
+/**
+*  load_bmfont() reading through an asset_source, so fonts can come from packs.
+*/
+inline bool load_bmfont(const asset_source& source, const std::filesystem::path& path, bmf_font& bmfont) {
+	if (auto binary = bmfont_binary_path(path); binary != path) {
+		if (auto data = source.load(binary); data && load_bmfont(data.data, data.size, bmfont)) return true;
+		bmfont = bmf_font{};
+	}
+	auto data = source.load(path);
+	return data && load_bmfont(data.data, data.size, bmfont);
+}
 
 class font {
 public:
@@ -81,97 +37,47 @@ public:
 
 	using character = bmf_font::bmf_char;
 
-	void load_font(SDL_Renderer* renderer, const std::filesystem::path& path) {
-		pugi::xml_document doc;
-		pugi::xml_parse_result result = doc.load_file(path.string().c_str());
-		if (result) {
-			bmf_font& bmfont = _bmfont;
-			auto font = doc.child("font");
-			{
-				auto info = font.child("info");
-				bmfont.info.face = info.attribute("face").as_string();
-				bmfont.info.size = info.attribute("size").as_int();
-				bmfont.info.bold = info.attribute("bold").as_int() != 0;
-				bmfont.info.italic = info.attribute("italic").as_int() != 0;
-				bmfont.info.charset = info.attribute("charset").as_string();
-				bmfont.info.unicode = info.attribute("unicode").as_int() != 0;
-				bmfont.info.stretchH = info.attribute("stretchH").as_int();
-				bmfont.info.smooth = info.attribute("smooth").as_int() != 0;
-				bmfont.info.aa = info.attribute("aa").as_int() != 0;
-				{
-					auto padding = info.attribute("padding").as_string();
-					auto list = split(padding, ',');
-					if (list.size() > 0) bmfont.info.padding.up = to_int(list[0]);
-					if (list.size() > 1) bmfont.info.padding.right = to_int(list[1]);
-					if (list.size() > 2) bmfont.info.padding.down = to_int(list[2]);
-					if (list.size() > 3) bmfont.info.padding.left = to_int(list[3]);
-				}
-				{
-					auto spacing = info.attribute("spacing").as_string();
-					auto list = split(spacing, ',');
-					if (list.size() > 0) bmfont.info.spacing.horizontal = to_int(list[0]);
-					if (list.size() > 1) bmfont.info.spacing.vertical = to_int(list[1]);
-				}
-				bmfont.info.outline = info.attribute("outline").as_int();
-			}
-			{
-				auto common = font.child("common");
-				bmfont.common.line_height = common.attribute("lineHeight").as_int();
-				bmfont.common.base = common.attribute("base").as_int();
-				bmfont.common.scale_width = common.attribute("scaleW").as_int();
-				bmfont.common.scale_height = common.attribute("scaleH").as_int();
-				bmfont.common.pages = common.attribute("pages").as_int();
-				bmfont.common.packed = common.attribute("packed").as_int() != 0;
-				bmfont.common.alpha_channel = decltype(bmfont.common.alpha_channel)(common.attribute("alphaChnl").as_int());
-				bmfont.common.red_channel = decltype(bmfont.common.red_channel)(common.attribute("redChnl").as_int());
-				bmfont.common.green_channel = decltype(bmfont.common.green_channel)(common.attribute("greenChnl").as_int());
-				bmfont.common.blue_channel = decltype(bmfont.common.blue_channel)(common.attribute("blueChnl").as_int());
-			}
-			auto pages = font.child("pages").children("page");
-			for (auto& page : pages) {
-				bmfont.pages.push_back({
-					page.attribute("id").as_int(),
-					page.attribute("file").as_string()
-					});
-			}
-			auto chars = font.child("chars").children("char");
-			for (auto& chara : chars) {
-				char32_t id = static_cast<char32_t>(chara.attribute("id").as_int());
-				bmfont.chars[id] = {
-					id,
-					chara.attribute("x").as_int(),
-					chara.attribute("y").as_int(),
-					chara.attribute("width").as_int(),
-					chara.attribute("height").as_int(),
-					chara.attribute("xoffset").as_int(),
-					chara.attribute("yoffset").as_int(),
-					chara.attribute("xadvance").as_int(),
-					chara.attribute("page").as_int(),
-					chara.attribute("chnl").as_int()
-				};
-			}
-			load_page_textures(bmfont, renderer, path.parent_path().string());
+	void load_font(const std::filesystem::path& path, asset_loader* loader = nullptr) {
+		bmf_font bmfont;
+		if (loader ? load_bmfont(loader->source(), path, bmfont) : load_bmfont(path, bmfont)) {
+			load_font(std::move(bmfont), path.parent_path(), loader);
 		}
 	}
 
-	void load_page_textures(const bmf_font& font, SDL_Renderer* renderer, const std::filesystem::path& dir) {
+	void load_font(bmf_font&& bmfont, const std::filesystem::path& dir, asset_loader* loader = nullptr) {
+		_bmfont = std::move(bmfont);
+		load_page_textures(_bmfont, dir, loader);
+	}
+
+	// 全ページのデコードをすぐに始める (loader があれば裏で)
+	// テクスチャにするのはアトラスを作らずに描いたときだけで、描画時に済ませる
+	void load_page_textures(const bmf_font& font, const std::filesystem::path& dir, asset_loader* loader = nullptr) {
+		_pages.assign(font.pages.size(), {});
+		_page_handles.clear();
 		for (auto& page : font.pages) {
-			if (auto* surface = STB_IMG_Load((dir / page.file).string().c_str())) {
-				SDL_SetColorKey(surface, SDL_TRUE, SDL_MapRGB(surface->format, 0, 0, 0));
-				_pages.push_back(make_texture_from_surface(renderer, surface));
-				SDL_FreeSurface(surface);
+			auto path = dir / page.file;
+			if (loader) {
+				_page_handles.push_back(loader->load_texture(path, set_color_key));
+
+			} else {
+				_page_handles.push_back(std::async(std::launch::deferred, [path] {
+					SDL_Pointer<SDL_Surface> surface;
+					if (auto* p = STB_IMG_Load(path.string().c_str())) {
+						surface = SDL_Pointer<SDL_Surface>(p, SDL_FreeSurface);
+						set_color_key(p);
+					}
+					return surface;
+				}).share());
 			}
 		}
 	}
 
-	bmf_font::bmf_char* get_char(char32_t codepoint) {
-		bmf_font::bmf_char* chara = nullptr;
-		if (auto it = _bmfont.chars.find(codepoint); it != _bmfont.chars.end()) {
-			chara = &it->second;
-		}
-		return chara;
+	inline const bmf_font::bmf_char* get_char(char32_t codepoint) const {
+		return _bmfont.chars.find(codepoint);
 	}
 
+	inline const bmf_font::bmf_char_table& chars() const { return _bmfont.chars; }
+
 	void put_char(SDL_Renderer* renderer, int x, int y, char32_t codepoint, const SDL_Color* color = nullptr) {
 		if (auto* chara = get_char(codepoint)) {
 			put_char(renderer, x, y, *chara, color);
@@ -179,18 +85,35 @@ public:
 	}
 
 	void put_char(SDL_Renderer* renderer, int x, int y, const character& chara, const SDL_Color* color = nullptr) {
-		if (auto page = find_page(chara.page)) {
+		put_char(renderer, _batch, x, y, chara, color);
+	}
+
+	void put_char(SDL_Renderer* renderer, glyph_batch& batch, int x, int y, const character& chara, const SDL_Color* color = nullptr) {
+		static const SDL_Color white{ 0xFF, 0xFF, 0xFF, 0xFF };
+		if (auto* page = load_page(renderer, chara.page)) {
 			SDL_Rect src_rect{ chara.x, chara.y, chara.width, chara.height };
 			SDL_Rect dst_rect{ x + chara.x_offset, y + chara.y_offset, chara.width, chara.height };
-			auto* p = page.get();
-			if (color) SDL_SetTextureColorMod(p, color->r, color->g, color->b);
-			SDL_RenderCopy(renderer, p, &src_rect, &dst_rect);
+			batch.add(page, src_rect, dst_rect, color ? *color : white);
 		}
 	}
 
-	void print(SDL_Renderer* renderer, int x, int y, tiny_utf8::utf8_string string) {
+	inline void flush(SDL_Renderer* renderer) {
+		_batch.flush(renderer);
+	}
+
+	inline void print(SDL_Renderer* renderer, int x, int y, std::string_view string) {
+		print_codepoints(renderer, x, y, utf8::codepoints(string));
+	}
+
+	inline void print(SDL_Renderer* renderer, int x, int y, std::u32string_view string) {
+		print_codepoints(renderer, x, y, string);
+	}
+
+	template<typename Codepoints>
+	void print_codepoints(SDL_Renderer* renderer, int x, int y, const Codepoints& codepoints) {
+		ALLOC_SCOPE("font::print");
 		int begin_x = x;
-		for (char32_t codepoint : string) {
+		for (char32_t codepoint : codepoints) {
 			if (codepoint == '\n') {
 				x = begin_x;
 				y += 8;
@@ -201,13 +124,45 @@ public:
 		}
 	}
 
+	// build_atlas() 用、ページをまだテクスチャにしていなければデコード済みの画像を返す
+	SDL_Pointer<SDL_Surface> page_surface(int page) const {
+		return (page >= 0 && static_cast<std::size_t>(page) < _page_handles.size()) ? _page_handles[page].surface() : SDL_Pointer<SDL_Surface>{};
+	}
+
 	SDL_Pointer<SDL_Texture> find_page(int page) {
-		return (page < _pages.size()) ? _pages[page] : SDL_Pointer<SDL_Texture>{};
+		return (page >= 0 && static_cast<std::size_t>(page) < _pages.size()) ? _pages[page] : SDL_Pointer<SDL_Texture>{};
+	}
+
+	inline std::size_t page_count() const { return _pages.size(); }
+
+	// 全グリフの x/y/page を書き換え、ページを差し替える
+	template<typename F>
+	void remap(const std::vector<SDL_Pointer<SDL_Texture>>& pages, F&& f) {
+		for (auto& chara : _bmfont.chars) f(chara);
+		_pages = pages;
+		_page_handles.clear();
+		_batch.clear();
 	}
 
 private:
+	// デコードが済んでいなければここで待つ
+	SDL_Texture* load_page(SDL_Renderer* renderer, int page) {
+		if (page < 0 || static_cast<std::size_t>(page) >= _pages.size()) return nullptr;
+		if (!_pages[page] && static_cast<std::size_t>(page) < _page_handles.size() && _page_handles[page].valid()) {
+			_pages[page] = _page_handles[page].get(renderer);
+			_page_handles[page] = {};
+		}
+		return _pages[page].get();
+	}
+
+	static void set_color_key(SDL_Surface* surface) {
+		SDL_SetColorKey(surface, SDL_TRUE, SDL_MapRGB(surface->format, 0, 0, 0));
+	}
+
 	bmf_font _bmfont;
 	std::vector<SDL_Pointer<SDL_Texture>> _pages;
+	std::vector<asset_loader::texture_handle> _page_handles;
+	glyph_batch _batch;
 };
 
 class font_set {
@@ -216,23 +171,244 @@ public:
 
 	using character = bmf_font::bmf_char;
 
-	void load_font(SDL_Renderer* renderer, const std::filesystem::path& path) {
+	inline void loader(const std::shared_ptr<asset_loader>& loader_ptr) {
+		_loader = loader_ptr;
+	}
+
+	void load_font(const std::filesystem::path& path) {
 		font newfont;
-		newfont.load_font(renderer, path);
+		newfont.load_font(path, _loader.get());
 		_fonts.push_back(newfont);
+		merge_font(_fonts.size() - 1);
+	}
+
+	/**
+	*  Load several fonts in fallback order. With a loader set, the .fnt
+	*  files are parsed in parallel and their pages start decoding at once.
+	*/
+	void load_fonts(const std::vector<std::filesystem::path>& paths) {
+		if (!_loader) {
+			for (auto& path : paths) load_font(path);
+			return;
+		}
+
+		std::vector<std::future<std::pair<bool, bmf_font>>> parsed;
+		for (auto& path : paths) {
+			parsed.push_back(_loader->async([path, loader = _loader.get()] {
+				std::pair<bool, bmf_font> result;
+				result.first = load_bmfont(loader->source(), path, result.second);
+				return result;
+			}));
+		}
+		for (std::size_t i = 0; i < paths.size(); ++i) {
+			auto [loaded, bmfont] = parsed[i].get();
+			font newfont;
+			if (loaded) newfont.load_font(std::move(bmfont), paths[i].parent_path(), _loader.get());
+			_fonts.push_back(newfont);
+			merge_font(_fonts.size() - 1);
+		}
 	}
 
 	void put_char(SDL_Renderer* renderer, int x, int y, char32_t codepoint, const SDL_Color *color = nullptr) {
 		font* target_font = nullptr;
-		character* chara = nullptr;
+		const character* chara = nullptr;
 		if (find_font(codepoint, target_font, chara)) {
-			target_font->put_char(renderer, x, y, *chara, color);
+			target_font->put_char(renderer, _batch, x, y, *chara, color);
+		}
+	}
+
+	inline void flush(SDL_Renderer* renderer) {
+		ALLOC_SCOPE("font_set::flush");
+		PROFILE_ZONE("font_set::flush");
+		_batch.flush(renderer);
+	}
+
+	/**
+	*  Repack the glyphs of every loaded font into shared atlas textures and
+	*  remap each bmf_char's x/y/page to them. Packing runs on the CPU from
+	*  the decoded page images, which are never turned into textures
+	*  themselves; call this before drawing with the fonts.
+	*
+	*  Pages are the smallest power of two from 256 up that holds every
+	*  glyph (atlas_size 0: up to the renderer's limit or 2048, otherwise
+	*  exactly atlas_size), cropped to the packed area.
+	*
+	*  \return false if a glyph doesn't fit, a page image is no longer
+	*  available or a texture can't be created; fonts are left untouched.
+	*/
+	bool build_atlas(SDL_Renderer* renderer, int atlas_size = 0) {
+		int max_size = atlas_size;
+		if (max_size <= 0) {
+			max_size = max_atlas_size;
+			if (SDL_RendererInfo info{}; SDL_GetRendererInfo(renderer, &info) == 0) {
+				if (info.max_texture_width > 0) max_size = std::min(max_size, info.max_texture_width);
+				if (info.max_texture_height > 0) max_size = std::min(max_size, info.max_texture_height);
+			}
+		}
+
+		// 同じ矩形を指すグリフは 1 つにまとめる
+		struct atlas_item {
+			std::uint64_t key;
+			std::uint16_t w, h;
+			std::uint8_t page;
+			std::uint16_t x, y;
+		};
+		auto make_key = [](std::size_t font_index, const character& c) {
+			return (std::uint64_t(font_index) << 56) | (std::uint64_t(c.page) << 48)
+				| (std::uint64_t(c.x) << 32) | (std::uint64_t(c.y) << 16)
+				| (std::uint64_t(c.width & 0xFF) << 8) | std::uint64_t(c.height & 0xFF);
+		};
+		std::vector<atlas_item> items;
+		for (std::size_t i = 0; i < _fonts.size(); ++i) {
+			for (auto& c : _fonts[i].chars()) {
+				if (c.width == 0 || c.height == 0) continue;
+				if (c.width > std::min(0xFF, max_size) || c.height > std::min(0xFF, max_size)) return false;
+				items.push_back({ make_key(i, c), c.width, c.height, 0, 0, 0 });
+			}
+		}
+		std::sort(items.begin(), items.end(), [](auto& a, auto& b) { return a.key < b.key; });
+		items.erase(std::unique(items.begin(), items.end(), [](auto& a, auto& b) { return a.key == b.key; }), items.end());
+
+		// 高さ順のシェルフ詰め、グリフ間は 1px 空ける
+		// 1 枚目の左上 2x2 は背景用の白、extents に各ページの使った範囲を返す
+		std::vector<atlas_item*> order;
+		for (auto& item : items) order.push_back(&item);
+		std::sort(order.begin(), order.end(), [](auto* a, auto* b) {
+			return (a->h != b->h) ? (a->h > b->h) : (a->w > b->w);
+		});
+		std::vector<SDL_Point> extents;
+		auto pack = [&](int size) {
+			extents.assign(1, { solid_size, solid_size });
+			int pen_x = solid_size + 1, pen_y = 0, shelf_h = solid_size;
+			for (auto* item : order) {
+				if (pen_x + item->w > size) {
+					pen_x = 0;
+					pen_y += shelf_h + 1;
+					shelf_h = 0;
+				}
+				if (pen_y + item->h > size) {
+					pen_x = pen_y = shelf_h = 0;
+					extents.push_back({ 0, 0 });
+				}
+				if (extents.size() > 0xFF) return false;
+				item->page = static_cast<std::uint8_t>(extents.size() - 1);
+				item->x = static_cast<std::uint16_t>(pen_x);
+				item->y = static_cast<std::uint16_t>(pen_y);
+				auto& extent = extents.back();
+				extent.x = std::max(extent.x, pen_x + item->w);
+				extent.y = std::max(extent.y, pen_y + item->h);
+				pen_x += item->w + 1;
+				shelf_h = std::max<int>(shelf_h, item->h);
+			}
+			return true;
+		};
+		bool packed = false;
+		for (int size = (atlas_size > 0) ? atlas_size : std::min(min_atlas_size, max_size);; size = std::min(size * 2, max_size)) {
+			packed = pack(size);
+			if ((packed && extents.size() == 1) || size >= max_size) break;
+		}
+		if (!packed) return false;
+
+		std::vector<SDL_Pointer<SDL_Surface>> surfaces;
+		for (auto& extent : extents) {
+			auto surface = SDL_Pointer<SDL_Surface>(SDL_CreateRGBSurfaceWithFormat(0, extent.x, extent.y, 32, SDL_PIXELFORMAT_RGBA32), SDL_FreeSurface);
+			if (!surface) return false;
+			surfaces.push_back(surface);
+		}
+		SDL_Rect solid{ 0, 0, solid_size, solid_size };
+		SDL_FillRect(surfaces.front().get(), &solid, SDL_MapRGBA(surfaces.front()->format, 0xFF, 0xFF, 0xFF, 0xFF));
+
+		// items は元のフォントとページの順に並んでいるので、ページごとにまとめて転送する
+		for (auto first = items.begin(); first != items.end();) {
+			const auto source_key = first->key >> 48;
+			auto last = std::find_if(first, items.end(), [source_key](auto& item) { return (item.key >> 48) != source_key; });
+			auto src = _fonts[source_key >> 8].page_surface(static_cast<int>(source_key & 0xFF));
+			if (!src) return false;
+
+			// 元の画素をそのまま写す (カラーキーの黒は透明のまま残る)
+			SDL_BlendMode before_mode;
+			SDL_GetSurfaceBlendMode(src.get(), &before_mode);
+			SDL_SetSurfaceBlendMode(src.get(), SDL_BLENDMODE_NONE);
+			for (; first != last; ++first) {
+				SDL_Rect src_rect{ int((first->key >> 32) & 0xFFFF), int((first->key >> 16) & 0xFFFF), first->w, first->h };
+				SDL_Rect dst_rect{ first->x, first->y, first->w, first->h };
+				SDL_BlitSurface(src.get(), &src_rect, surfaces[first->page].get(), &dst_rect);
+			}
+			SDL_SetSurfaceBlendMode(src.get(), before_mode);
+		}
+
+		auto pages = upload_atlas(renderer, surfaces);
+		if (pages.empty()) return false;
+
+		for (std::size_t i = 0; i < _fonts.size(); ++i) {
+			_fonts[i].remap(pages, [&](character& c) {
+				if (c.width == 0 || c.height == 0) return;
+				auto key = make_key(i, c);
+				auto it = std::lower_bound(items.begin(), items.end(), key, [](auto& a, std::uint64_t k) { return a.key < k; });
+				c.x = it->x;
+				c.y = it->y;
+				c.page = it->page;
+			});
+		}
+		_batch.clear();
+
+		_atlas_surfaces = std::move(surfaces);
+		_atlas_fonts = _fonts.size();
+		_atlas = (pages.size() == 1) ? pages.front() : nullptr;
+		_solid_uv = {
+			float(solid_size / 2) / _atlas_surfaces.front()->w,
+			float(solid_size / 2) / _atlas_surfaces.front()->h
+		};
+		return true;
+	}
+
+	/**
+	*  Re-create the atlas textures from the pixels kept by build_atlas(),
+	*  e.g. after SDL_RENDER_DEVICE_RESET has dropped every texture.
+	*/
+	bool restore_atlas(SDL_Renderer* renderer) {
+		if (_atlas_surfaces.empty()) return false;
+		auto pages = upload_atlas(renderer, _atlas_surfaces);
+		if (pages.empty()) return false;
+		for (std::size_t i = 0; i < _atlas_fonts; ++i) {
+			_fonts[i].remap(pages, [](character&) {});
 		}
+		_batch.clear();
+		if (_atlas) _atlas = pages.front();
+		return true;
+	}
+
+	/**
+	*  The single texture holding every glyph after build_atlas(), or null
+	*  when the glyphs are spread over several textures.
+	*/
+	inline SDL_Texture* atlas() const { return _atlas.get(); }
+
+	// atlas() 上の白い点の UV
+	inline const SDL_FPoint& solid_uv() const { return _solid_uv; }
+
+	inline void print(SDL_Renderer* renderer, int x, int y, std::string_view string) {
+		print_codepoints(renderer, x, y, utf8::codepoints(string));
+	}
+
+	inline void print(SDL_Renderer* renderer, int x, int y, std::u32string_view string) {
+		print_codepoints(renderer, x, y, string);
+	}
+
+	inline void print(SDL_Renderer* renderer, const SDL_Rect& rect, std::string_view string) {
+		print_codepoints(renderer, rect, utf8::codepoints(string));
+	}
+
+	inline void print(SDL_Renderer* renderer, const SDL_Rect& rect, std::u32string_view string) {
+		print_codepoints(renderer, rect, string);
 	}
 
-	void print(SDL_Renderer* renderer, int x, int y, tiny_utf8::utf8_string string) {
+	template<typename Codepoints>
+	void print_codepoints(SDL_Renderer* renderer, int x, int y, const Codepoints& codepoints) {
+		ALLOC_SCOPE("font_set::print");
+		PROFILE_ZONE("font_set::print");
 		int begin_x = x;
-		for (char32_t codepoint : string) {
+		for (char32_t codepoint : codepoints) {
 			if (codepoint == '\n') {
 				x = begin_x;
 				y += 8;
@@ -244,10 +420,13 @@ public:
 		}
 	}
 
-	void print(SDL_Renderer* renderer, const SDL_Rect &rect, tiny_utf8::utf8_string string) {
+	template<typename Codepoints>
+	void print_codepoints(SDL_Renderer* renderer, const SDL_Rect &rect, const Codepoints& codepoints) {
+		ALLOC_SCOPE("font_set::print");
+		PROFILE_ZONE("font_set::print");
 		SDL_Rect render_rect = rect;
 		int begin_x = rect.x;
-		for (char32_t codepoint : string) {
+		for (char32_t codepoint : codepoints) {
 			if (codepoint == '\n') {
 				render_rect.x = begin_x;
 				render_rect.y += 8;
@@ -267,21 +446,58 @@ public:
 		}
 	}
 
-	bool find_font(char32_t codepoint, font*& out_font, character*& out_char) {
+	bool find_font(char32_t codepoint, font*& out_font, const character*& out_char) {
 		bool found = false;
-		for (auto& font : _fonts) {
-			if (auto* chara = font.get_char(codepoint)) {
-				out_font = &font;
-				out_char = chara;
-				found = true;
-				break;
-			}
+		if (auto ref = _glyphs.find(codepoint); ref != glyph_ref_none) {
+			auto& font = _fonts[ref >> 16];
+			out_font = &font;
+			out_char = &font.chars()[static_cast<bmf_font::bmf_char_table::index_type>(ref & 0xFFFF)];
+			found = true;
 		}
 		return found;
 	}
 
 private:
+	// (font index << 16) | glyph index, resolved in fallback order
+	using glyph_ref = std::uint32_t;
+	static constexpr glyph_ref glyph_ref_none = 0xFFFFFFFF;
+
+	static constexpr int solid_size = 2;
+	static constexpr int min_atlas_size = 256;
+	static constexpr int max_atlas_size = 2048;
+
+	// 静的テクスチャにするので、描画先のリセットでは中身が失われない
+	static std::vector<SDL_Pointer<SDL_Texture>> upload_atlas(SDL_Renderer* renderer, const std::vector<SDL_Pointer<SDL_Surface>>& surfaces) {
+		std::vector<SDL_Pointer<SDL_Texture>> pages;
+		for (auto& surface : surfaces) {
+			auto tex = make_texture_from_surface(renderer, surface.get());
+			if (!tex) return {};
+			SDL_SetTextureBlendMode(tex.get(), SDL_BLENDMODE_BLEND);
+			pages.push_back(tex);
+		}
+		return pages;
+	}
+
+	void merge_font(std::size_t font_index) {
+		_atlas.reset();
+		auto& chars = _fonts[font_index].chars();
+		for (auto& chara : chars) {
+			if (!_glyphs.contains(chara.id)) {
+				_glyphs.insert(chara.id, static_cast<glyph_ref>((font_index << 16) | chars.index_of(chara.id)));
+			}
+		}
+	}
+
 	std::vector<font> _fonts;
+	codepoint_table<glyph_ref, glyph_ref_none> _glyphs;
+	glyph_batch _batch;
+	std::shared_ptr<asset_loader> _loader;
+	SDL_Pointer<SDL_Texture> _atlas;
+	SDL_FPoint _solid_uv{};
+
+	// build_atlas() で詰めた画素と、その時点のフォント数 (restore_atlas() 用)
+	std::vector<SDL_Pointer<SDL_Surface>> _atlas_surfaces;
+	std::size_t _atlas_fonts = 0;
 };
 
 #endif // FONT_HPP_
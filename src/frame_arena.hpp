@@ -0,0 +1,103 @@
+﻿#ifndef FRAME_ARENA_HPP_
+#define FRAME_ARENA_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <algorithm>
+#include <new>
+
+/**
+*  Bump allocator for data that lives no longer than one frame.
+*
+*  Hand it to std::pmr containers; deallocation is a no-op and reset()
+*  rewinds everything at once. Requests that do not fit go to the global
+*  heap until the next reset(), which then grows the buffer to the peak of
+*  that frame so later frames stay inside it.
+*/
+class frame_arena : public std::pmr::memory_resource {
+public:
+	explicit frame_arena(std::size_t capacity = 256 * 1024) { reserve(capacity); }
+	virtual ~frame_arena() { release_overflow(); }
+
+	frame_arena(const frame_arena&) = delete;
+	frame_arena& operator=(const frame_arena&) = delete;
+
+	// フレームの頭で呼ぶ
+	void reset() {
+		const std::size_t frame_peak = _used + _overflow_bytes;
+		_peak = std::max(_peak, frame_peak);
+		release_overflow();
+		if (frame_peak > _capacity) reserve(frame_peak + frame_peak / 2);
+		_used = 0;
+	}
+
+	inline std::size_t used() const { return _used + _overflow_bytes; }
+	inline std::size_t capacity() const { return _capacity; }
+	inline std::size_t peak() const { return _peak; }
+
+	// reset() 以降、バッファに収まらずヒープから取った回数
+	inline std::size_t overflow_count() const { return _overflow_count; }
+
+protected:
+	virtual void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+		const auto base = reinterpret_cast<std::uintptr_t>(_buffer.get());
+		const auto top = (base + _used + alignment - 1) & ~std::uintptr_t(alignment - 1);
+		const std::size_t offset = static_cast<std::size_t>(top - base);
+		if (offset + bytes <= _capacity) {
+			_used = offset + bytes;
+			return _buffer.get() + offset;
+		}
+		return allocate_overflow(bytes, alignment);
+	}
+
+	virtual void do_deallocate(void*, std::size_t, std::size_t) override {}
+
+	virtual bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+		return this == &other;
+	}
+
+private:
+	struct overflow_block {
+		overflow_block* next;
+	};
+
+	void reserve(std::size_t capacity) {
+		_buffer.reset(new std::byte[capacity]);
+		_capacity = capacity;
+	}
+
+	void* allocate_overflow(std::size_t bytes, std::size_t alignment) {
+		const std::size_t total = sizeof(overflow_block) + alignment + bytes;
+		auto* block = static_cast<overflow_block*>(::operator new(total));
+		block->next = _overflow;
+		_overflow = block;
+		_overflow_bytes += bytes;
+		++_overflow_count;
+
+		const auto payload = reinterpret_cast<std::uintptr_t>(block + 1);
+		return reinterpret_cast<void*>((payload + alignment - 1) & ~std::uintptr_t(alignment - 1));
+	}
+
+	void release_overflow() {
+		while (_overflow) {
+			auto* next = _overflow->next;
+			::operator delete(_overflow);
+			_overflow = next;
+		}
+		_overflow_bytes = 0;
+		_overflow_count = 0;
+	}
+
+	std::unique_ptr<std::byte[]> _buffer;
+	std::size_t _capacity = 0;
+	std::size_t _used = 0;
+	std::size_t _peak = 0;
+
+	overflow_block* _overflow = nullptr;
+	std::size_t _overflow_bytes = 0;
+	std::size_t _overflow_count = 0;
+};
+
+#endif // FRAME_ARENA_HPP_
@@ -0,0 +1,185 @@
+﻿#ifndef GLYPH_BATCH_HPP_
+#define GLYPH_BATCH_HPP_
+
+#include <SDL.h>
+
+#include <vector>
+#include <algorithm>
+
+#include "render.hpp"
+
+/**
+*  Collects textured, vertex-colored quads per texture and submits each
+*  texture's quads with a single SDL_RenderGeometry call.
+*/
+class glyph_batch {
+public:
+	glyph_batch() {}
+
+	void add(SDL_Texture* texture, const SDL_Rect& src, const SDL_Rect& dst, const SDL_Color& color) {
+		auto& b = find_bucket(texture);
+		if (b.inv_w == 0.f) return;
+
+		const float u0 = src.x * b.inv_w;
+		const float v0 = src.y * b.inv_h;
+		const float u1 = (src.x + src.w) * b.inv_w;
+		const float v1 = (src.y + src.h) * b.inv_h;
+		const float x0 = static_cast<float>(dst.x);
+		const float y0 = static_cast<float>(dst.y);
+		const float x1 = static_cast<float>(dst.x + dst.w);
+		const float y1 = static_cast<float>(dst.y + dst.h);
+
+		// テクスチャカラーモッドと同じく α は使わない
+		const SDL_Color c{ color.r, color.g, color.b, 0xFF };
+
+		const int base = static_cast<int>(b.vertices.size());
+		b.vertices.push_back({ { x0, y0 }, c, { u0, v0 } });
+		b.vertices.push_back({ { x1, y0 }, c, { u1, v0 } });
+		b.vertices.push_back({ { x1, y1 }, c, { u1, v1 } });
+		b.vertices.push_back({ { x0, y1 }, c, { u0, v1 } });
+
+		b.indices.push_back(base + 0);
+		b.indices.push_back(base + 1);
+		b.indices.push_back(base + 2);
+		b.indices.push_back(base + 0);
+		b.indices.push_back(base + 2);
+		b.indices.push_back(base + 3);
+	}
+
+	void flush(SDL_Renderer* renderer) {
+		for (auto& b : _buckets) {
+			if (!b.indices.empty()) {
+				render::geometry(
+					renderer,
+					b.texture,
+					b.vertices.data(),
+					static_cast<int>(b.vertices.size()),
+					b.indices.data(),
+					static_cast<int>(b.indices.size())
+				);
+				b.vertices.clear();
+				b.indices.clear();
+			}
+			// 作り直したテクスチャが同じアドレスに来ることがあるので、大きさは flush のたびに取り直す
+			b.texture = nullptr;
+			b.inv_w = b.inv_h = 0.f;
+		}
+		_last = 0;
+	}
+
+	void clear() {
+		_buckets.clear();
+		_last = 0;
+	}
+
+	inline bool empty() const {
+		for (auto& b : _buckets) {
+			if (!b.indices.empty()) return false;
+		}
+		return true;
+	}
+
+private:
+	struct bucket {
+		SDL_Texture* texture = nullptr;
+		float inv_w = 0.f;
+		float inv_h = 0.f;
+		std::vector<SDL_Vertex> vertices;
+		std::vector<int> indices;
+	};
+
+	bucket& find_bucket(SDL_Texture* texture) {
+		if (_last < _buckets.size() && _buckets[_last].texture == texture) {
+			return _buckets[_last];
+		}
+		for (_last = 0; _last < _buckets.size(); ++_last) {
+			if (_buckets[_last].texture == texture) return _buckets[_last];
+		}
+
+		// 空いたバケツがあれば配列ごと使い回す
+		auto it = std::find_if(_buckets.begin(), _buckets.end(), [](const bucket& b) { return b.texture == nullptr; });
+		_last = static_cast<std::size_t>(it - _buckets.begin());
+		auto& b = (it != _buckets.end()) ? *it : _buckets.emplace_back();
+		b.texture = texture;
+		if (int w = 0, h = 0; SDL_QueryTexture(texture, nullptr, nullptr, &w, &h) == 0 && w > 0 && h > 0) {
+			b.inv_w = 1.f / w;
+			b.inv_h = 1.f / h;
+		}
+		return b;
+	}
+
+	std::vector<bucket> _buckets;
+	std::size_t _last = 0;
+};
+
+/**
+*  Collects solid rectangles, merging horizontally adjacent ones of the same
+*  color into runs, and submits each color with one SDL_RenderFillRects call.
+*/
+class fill_batch {
+public:
+	fill_batch() {}
+
+	void add(const SDL_Rect& rect, const SDL_Color& color) {
+		auto& b = find_bucket(color);
+		if (!b.rects.empty()) {
+			auto& last = b.rects.back();
+			if (last.y == rect.y && last.h == rect.h && last.x + last.w == rect.x) {
+				last.w += rect.w;
+				return;
+			}
+		}
+		b.rects.push_back(rect);
+	}
+
+	void flush(SDL_Renderer* renderer) {
+		for (auto& b : _buckets) {
+			if (!b.rects.empty()) {
+				render::draw_color(renderer, b.color.r, b.color.g, b.color.b, 0xFF);
+				render::fill_rects(renderer, b.rects.data(), static_cast<int>(b.rects.size()));
+				b.rects.clear();
+			}
+			// 色が変わり続けても (フェードなど) バケツが増えないよう、色の割り当ては flush ごとに外す
+			b.used = false;
+		}
+		_last = 0;
+	}
+
+	inline bool empty() const {
+		for (auto& b : _buckets) {
+			if (!b.rects.empty()) return false;
+		}
+		return true;
+	}
+
+private:
+	struct bucket {
+		SDL_Color color{};
+		bool used = false;
+		std::vector<SDL_Rect> rects;
+	};
+
+	bucket& find_bucket(const SDL_Color& color) {
+		auto same = [&color](const bucket& b) {
+			return b.used && b.color.r == color.r && b.color.g == color.g && b.color.b == color.b;
+		};
+		if (_last < _buckets.size() && same(_buckets[_last])) {
+			return _buckets[_last];
+		}
+		for (_last = 0; _last < _buckets.size(); ++_last) {
+			if (same(_buckets[_last])) return _buckets[_last];
+		}
+		// 空いたバケツがあれば配列ごと使い回す
+		auto it = std::find_if(_buckets.begin(), _buckets.end(), [](const bucket& b) { return !b.used; });
+		_last = static_cast<std::size_t>(it - _buckets.begin());
+		auto& b = (it != _buckets.end()) ? *it : _buckets.emplace_back();
+		b.color = color;
+		b.used = true;
+		return b;
+	}
+
+	std::vector<bucket> _buckets;
+	std::size_t _last = 0;
+};
+
+#endif // GLYPH_BATCH_HPP_
@@ -0,0 +1,127 @@
+﻿#ifndef GRID_RENDERER_HPP_
+#define GRID_RENDERER_HPP_
+
+#include <SDL.h>
+
+#include <vector>
+
+#include "render.hpp"
+
+/**
+*  Fixed grid of cells drawn from one atlas texture with a single
+*  SDL_RenderGeometry call. Every cell owns a background quad and a glyph
+*  quad that are allocated once; changing a cell only rewrites its colors,
+*  UVs and glyph position. Backgrounds are drawn before all glyphs so glyphs
+*  overhanging into a neighbor stay visible.
+*/
+class grid_renderer {
+public:
+	grid_renderer() {}
+
+	void resize(int cols, int rows, int cell_w, int cell_h) {
+		_cols = cols;
+		_rows = rows;
+		_cell_w = cell_w;
+		_cell_h = cell_h;
+
+		const int count = cols * rows;
+		_vertices.assign(std::size_t(count) * 8, SDL_Vertex{});
+		_indices.resize(std::size_t(count) * 12);
+
+		int* bg = _indices.data();
+		int* glyph = _indices.data() + std::size_t(count) * 6;
+		for (int i = 0; i < count; ++i) {
+			const int b = i * 8;
+			const int g = b + 4;
+			const int quad[] = { 0, 1, 2, 0, 2, 3 };
+			for (int k = 0; k < 6; ++k) {
+				bg[i * 6 + k] = b + quad[k];
+				glyph[i * 6 + k] = g + quad[k];
+			}
+
+			const float x0 = static_cast<float>((i % cols) * cell_w);
+			const float y0 = static_cast<float>((i / cols) * cell_h);
+			const float x1 = x0 + cell_w;
+			const float y1 = y0 + cell_h;
+			_vertices[b + 0].position = { x0, y0 };
+			_vertices[b + 1].position = { x1, y0 };
+			_vertices[b + 2].position = { x1, y1 };
+			_vertices[b + 3].position = { x0, y1 };
+		}
+	}
+
+	// テクスチャの大きさと、背景に使う白い 1 点の UV
+	void atlas(SDL_Texture* texture, const SDL_FPoint& solid_uv) {
+		_texture = texture;
+		_solid_uv = solid_uv;
+		_inv_w = _inv_h = 0.f;
+		if (int w = 0, h = 0; texture && SDL_QueryTexture(texture, nullptr, nullptr, &w, &h) == 0 && w > 0 && h > 0) {
+			_inv_w = 1.f / w;
+			_inv_h = 1.f / h;
+		}
+	}
+	inline SDL_Texture* atlas() const { return _texture; }
+
+	void set_background(int x, int y, const SDL_Color& color) {
+		SDL_Vertex* v = &_vertices[std::size_t(y * _cols + x) * 8];
+		const SDL_Color c{ color.r, color.g, color.b, 0xFF };
+		for (int k = 0; k < 4; ++k) {
+			v[k].color = c;
+			v[k].tex_coord = _solid_uv;
+		}
+	}
+
+	// src はアトラス上の矩形、dst はセル左上からの相対位置
+	void set_glyph(int x, int y, const SDL_Rect& src, const SDL_Rect& dst, const SDL_Color& color) {
+		SDL_Vertex* v = &_vertices[std::size_t(y * _cols + x) * 8 + 4];
+		const float x0 = static_cast<float>(x * _cell_w + dst.x);
+		const float y0 = static_cast<float>(y * _cell_h + dst.y);
+		const float x1 = x0 + dst.w;
+		const float y1 = y0 + dst.h;
+		const float u0 = src.x * _inv_w;
+		const float v0 = src.y * _inv_h;
+		const float u1 = (src.x + src.w) * _inv_w;
+		const float v1 = (src.y + src.h) * _inv_h;
+		const SDL_Color c{ color.r, color.g, color.b, 0xFF };
+		v[0] = { { x0, y0 }, c, { u0, v0 } };
+		v[1] = { { x1, y0 }, c, { u1, v0 } };
+		v[2] = { { x1, y1 }, c, { u1, v1 } };
+		v[3] = { { x0, y1 }, c, { u0, v1 } };
+	}
+
+	void clear_glyph(int x, int y) {
+		SDL_Vertex* v = &_vertices[std::size_t(y * _cols + x) * 8 + 4];
+		for (int k = 0; k < 4; ++k) v[k] = SDL_Vertex{};
+	}
+
+	void draw(SDL_Renderer* renderer) {
+		if (!_texture || _indices.empty()) return;
+		render::geometry(
+			renderer,
+			_texture,
+			_vertices.data(),
+			static_cast<int>(_vertices.size()),
+			_indices.data(),
+			static_cast<int>(_indices.size())
+		);
+	}
+
+	inline int cols() const { return _cols; }
+	inline int rows() const { return _rows; }
+
+private:
+	int _cols = 0;
+	int _rows = 0;
+	int _cell_w = 0;
+	int _cell_h = 0;
+
+	SDL_Texture* _texture = nullptr;
+	SDL_FPoint _solid_uv{};
+	float _inv_w = 0.f;
+	float _inv_h = 0.f;
+
+	std::vector<SDL_Vertex> _vertices;
+	std::vector<int> _indices;
+};
+
+#endif // GRID_RENDERER_HPP_
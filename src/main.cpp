@@ -5,6 +5,11 @@
 #include "util.hpp"
 #include "font.hpp"
 #include "console.hpp"
+#include "compositor.hpp"
+#include "message_log.hpp"
+#include "profiler.hpp"
+#include "render.hpp"
+#include "asset_loader.hpp"
 
 #include "imgui.h"
 #include "imgui_impl_sdl.h"
@@ -13,6 +18,9 @@
 #define SDL_STB_IMAGE_IMPLEMENTATION
 #include "SDL_stb_image.hpp"
 
+#define ALLOC_TRACKER_IMPLEMENTATION
+#include "alloc_tracker.hpp"
+
 #include "generated/Silver.cpp"
 
 namespace {
@@ -42,19 +50,47 @@ public:
 			SDL_RENDERER_PRESENTVSYNC | SDL_RENDERER_ACCELERATED
 		)
 		) {
-			if (auto bmp = SDL_LoadBMP("assets/test.bmp")) {
-				_tex = make_texture_from_surface(renderer(), bmp);
-				SDL_FreeSurface(bmp);
+			// assets.pak の上に mods/*.pak を重ね、無ければ個別ファイルを読む
+			auto source = std::make_shared<asset_source>();
+			source->mount("assets.pak");
+			if (std::error_code ec; std::filesystem::is_directory("mods", ec)) {
+				std::vector<std::filesystem::path> mods;
+				for (auto& entry : std::filesystem::directory_iterator("mods", ec)) {
+					if (entry.path().extension() == ".pak") mods.push_back(entry.path());
+				}
+				std::sort(mods.begin(), mods.end());
+				for (auto& mod : mods) source->mount(mod);
 			}
+			_loader = std::make_shared<asset_loader>(source);
+			auto background = _loader->load_texture("assets/test.bmp");
+
+			// 日本語グリフのラスタライズは重いので、まだコンテキストに繋いでいないアトラスに裏で作らせる
+			// ImGui は共有されたアトラスを描画中にも触るので、コンテキストは出来上がってから作る
+			_imgui_fonts = std::make_unique<ImFontAtlas>();
+			auto imgui_fonts = _loader->async([fonts = _imgui_fonts.get()] {
+				fonts->AddFontFromMemoryCompressedTTF(
+					Silver_compressed_data,
+					Silver_compressed_size,
+					21,
+					nullptr,
+					fonts->GetGlyphRangesJapanese()
+				);
+				fonts->Build();
+			});
 
 			SDL_SetWindowMinimumSize(window(), framebuffer_width, framebuffer_height);
+			idle_mode(true);
 			//SDL_RenderSetLogicalSize(renderer(), framebuffer_width, framebuffer_height);
 			//SDL_RenderSetIntegerScale(renderer(), SDL_TRUE);
 
 			_font = std::make_shared<font_set>();
-			_font->load_font(renderer(), "assets/font/modern_dos.fnt");
-			_font->load_font(renderer(), "assets/font/unscii.fnt");
-			_font->load_font(renderer(), "assets/font/misaki_gothic_2nd.fnt");
+			_font->loader(_loader);
+			_font->load_fonts({
+				"assets/font/modern_dos.fnt",
+				"assets/font/unscii.fnt",
+				"assets/font/misaki_gothic_2nd.fnt",
+			});
+			_font->build_atlas(renderer());
 
 			_console.current_font(_font);
 			_console.pos(cell_width*5, cell_height*3);
@@ -73,20 +109,22 @@ public:
 			_console.print(u8"01234567890123456789012345678901234567890123456789", 0, 0);
 			_console.print(u8"ABCDE", console::option::inverse);
 
+			_log.attach(_console, { 8, 15, console_columns - 8, console_rows - 15 });
+			_log.add(u8"ホイールでログを遡る、クリックで行を足す", { 0xFF, 0xFF, 0xFF, 0xFF });
+
+			_tex = background.get(renderer());
+			static const SDL_Rect background_rect{ 0, 0, framebuffer_width, framebuffer_height };
+			static const SDL_Rect sprite_rect{ 0, 0, 32, 32 };
+			_background_layer = _compositor.add(_tex, &background_rect, { 0, 0, window_width, window_height }, 0);
+			_sprite_layer = _compositor.add(_tex, &sprite_rect, sprite_rect, 1);
+			_console_layer = _compositor.add(_console, 2);
+
+			imgui_fonts.wait();
 			IMGUI_CHECKVERSION();
-			ImGui::CreateContext();
+			ImGui::CreateContext(_imgui_fonts.get());
 			ImGui::StyleColorsDark();
 			ImGui_ImplSDL2_InitForSDLRenderer(window(), renderer());
 			ImGui_ImplSDLRenderer_Init(renderer());
-
-			ImGuiIO& io = ImGui::GetIO();
-			io.Fonts->AddFontFromMemoryCompressedTTF(
-				Silver_compressed_data,
-				Silver_compressed_size,
-				21,
-				nullptr,
-				io.Fonts->GetGlyphRangesJapanese()
-			);
 		}
 		return initialized();
 	}
@@ -105,24 +143,17 @@ protected:
 	}
 
 	virtual void draw() override {
-		static const SDL_Rect src_rect{ 0, 0, framebuffer_width, framebuffer_height };
-		static SDL_Rect src_rect2{ 0, 0, 32, 32 };
 		static SDL_Rect target_rect{ 0, 0, 32, 32 };
 
 		//SDL_GetMouseLogicalState(window(), renderer(), &target_rect.x, &target_rect.y);
 
 		int state = SDL_GetMouseState(&target_rect.x, &target_rect.y);
 
-		SDL_SetRenderDrawColor(renderer(), 0x80, 0x80, 0x80, 0);
-		SDL_RenderClear(renderer());
-
-		if (_tex) {
-			SDL_RenderCopy(renderer(), _tex.get(), &src_rect, nullptr);
-			SDL_RenderCopy(renderer(), _tex.get(), &src_rect2, &target_rect);
-		}
+		int window_w, window_h;
+		SDL_GetWindowSize(window(), &window_w, &window_h);
+		_compositor.rect(_background_layer, { 0, 0, window_w, window_h });
+		_compositor.rect(_sprite_layer, target_rect);
 		{
-			int window_w, window_h;
-			SDL_GetWindowSize(window(), &window_w, &window_h);
 			_console.scale(std::min(window_w / _console.w(), window_h / _console.h()));
 			_console.pos(
 				(window_w - _console.w() * _console.scale()) / 2,
@@ -132,40 +163,155 @@ protected:
 		_console.begin(renderer());
 		_console.flush(renderer());
 		_console.print(renderer(), u8"あいうえおかきくけこ\nハローワールドAAAテスト\nÅǢÅ", (target_rect.x - _console.x()) / _console.scale(), (target_rect.y - _console.y()) / _console.scale());
-		_console.end(renderer());
+		_console.finish(renderer());
+
+		// 変化したレイヤーの範囲だけ合成し直して画面に写す
+		_compositor.compose(renderer(), window_w, window_h);
+		_compositor.present(renderer());
 
-		ImGui_ImplSDLRenderer_NewFrame();
-		ImGui_ImplSDL2_NewFrame();
-		ImGui::NewFrame();
+		{
+			PROFILE_ZONE("ImGui");
+			ImGui_ImplSDLRenderer_NewFrame();
+			ImGui_ImplSDL2_NewFrame();
+			ImGui::NewFrame();
+
+			static bool show_demo_window = true;
+			if (show_demo_window) ImGui::ShowDemoWindow(&show_demo_window);
+
+			ImGui::Begin(u8"Test Window");
+			ImGui::Checkbox(u8"Demo Window", &show_demo_window);
+			ImGui::Text(u8"Hello, World!");
+			ImGui::Text(u8"X = %d\nY = %d", target_rect.x - _console.x(), target_rect.y - _console.y());
+			if (alloc_tracker::enabled && ImGui::CollapsingHeader(u8"Allocations")) {
+				auto& frame = alloc_tracker::frame();
+				ImGui::Text(u8"frame: %llu (%llu bytes), free %llu", (unsigned long long)frame.allocations, (unsigned long long)frame.bytes, (unsigned long long)frame.frees);
+				for (int i = 0; i < alloc_tracker::scope_count(); ++i) {
+					auto& counters = alloc_tracker::scope_frame(i);
+					ImGui::Text(u8"  %s: %llu (%llu bytes)", alloc_tracker::scope_name(i), (unsigned long long)counters.allocations, (unsigned long long)counters.bytes);
+				}
+			}
+			ImGui::End();
 
-		static bool show_demo_window = true;
-		if (show_demo_window) ImGui::ShowDemoWindow(&show_demo_window);
+			draw_profiler();
+			draw_render_stats();
 
-		ImGui::Begin(u8"Test Window");
-		ImGui::Checkbox(u8"Demo Window", &show_demo_window);
-		ImGui::Text(u8"Hello, World!");
-		ImGui::Text(u8"X = %d\nY = %d", target_rect.x - _console.x(), target_rect.y - _console.y());
-		ImGui::End();
+			ImGui::Render();
+			ImGui_ImplSDLRenderer_RenderDrawData(ImGui::GetDrawData());
+		}
+	}
 
-		ImGui::Render();
-		ImGui_ImplSDLRenderer_RenderDrawData(ImGui::GetDrawData());
+	// 入力が無い間はコンソールに書き込みがあったときだけ描く
+	virtual bool needs_redraw() override {
+		return _console.dirty();
 	}
 
 	virtual void poll_event() override {
 		ImGui_ImplSDL2_ProcessEvent(event());
+		switch (event()->type) {
+		case SDL_RENDER_DEVICE_RESET:
+			// 静的テクスチャも失われるのでアトラスを作り直す (描画先のリセットなら残っている)
+			_font->restore_atlas(renderer());
+			[[fallthrough]];
+		case SDL_RENDER_TARGETS_RESET:
+			_console.invalidate();
+			_compositor.invalidate();
+			break;
+		case SDL_MOUSEWHEEL:
+			_log.scroll(event()->wheel.y);
+			break;
+		case SDL_MOUSEBUTTONDOWN:
+			_log.add(string_format(&arena(), u8"メッセージ %zu", _log.size()));
+			break;
+		}
 	}
 
 private:
+	// フレーム時間の推移と、区間ごとの内訳
+	void draw_profiler() {
+		if (!profiler::enabled) return;
+
+		ImGui::SetNextWindowSize(ImVec2(360, 420), ImGuiCond_FirstUseEver);
+		ImGui::Begin(u8"Profiler");
+		ImGui::Text(u8"frame: %.2f ms", profiler::last_frame_time());
+		ImGui::PlotLines(u8"##frame", profiler::frame_times(), profiler::history_size, profiler::offset(), nullptr, 0.f, 33.3f, ImVec2(0, 60));
+		if (ImGui::BeginTable(u8"zones", 3, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+			ImGui::TableSetupColumn(u8"zone");
+			ImGui::TableSetupColumn(u8"ms");
+			ImGui::TableSetupColumn(u8"history");
+			ImGui::TableHeadersRow();
+			for (int i = 0; i < profiler::zone_count(); ++i) {
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::TextUnformatted(profiler::zone_name(i));
+				ImGui::TableNextColumn();
+				ImGui::Text(u8"%.3f", profiler::last_zone_time(i));
+				ImGui::TableNextColumn();
+				ImGui::PlotLines(profiler::zone_name(i), profiler::zone_times(i), profiler::history_size, profiler::offset(), u8"", 0.f, 16.7f, ImVec2(120, 20));
+			}
+			ImGui::EndTable();
+		}
+		ImGui::End();
+	}
+
+	// 直前のフレームの描画呼び出しと状態変更の回数 (ImGui 自身の描画は含まない)
+	void draw_render_stats() {
+		ImGui::Begin(u8"Renderer", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+		auto& frame = render::frame();
+		auto& peak = render::peak();
+		ImGui::Text(u8"draw calls: %u (peak %u)", frame.draw_calls(), peak.draw_calls());
+		ImGui::Text(u8"state changes: %u (peak %u)", frame.state_changes(), peak.state_changes());
+		if (ImGui::BeginTable(u8"render", 3, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit)) {
+			ImGui::TableSetupColumn(u8"counter");
+			ImGui::TableSetupColumn(u8"frame");
+			ImGui::TableSetupColumn(u8"peak");
+			ImGui::TableHeadersRow();
+			auto row = [](const char* name, std::uint32_t value, std::uint32_t max) {
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::TextUnformatted(name);
+				ImGui::TableNextColumn();
+				ImGui::Text(u8"%u", value);
+				ImGui::TableNextColumn();
+				ImGui::Text(u8"%u", max);
+			};
+			row(u8"RenderCopy", frame.copies, peak.copies);
+			row(u8"RenderFillRect(s)", frame.fill_rects, peak.fill_rects);
+			row(u8"RenderGeometry", frame.geometries, peak.geometries);
+			row(u8"RenderClear", frame.clears, peak.clears);
+			row(u8"rects", frame.rects, peak.rects);
+			row(u8"vertices", frame.vertices, peak.vertices);
+			row(u8"indices", frame.indices, peak.indices);
+			row(u8"texture binds", frame.texture_binds, peak.texture_binds);
+			row(u8"TextureColorMod", frame.color_mods, peak.color_mods);
+			row(u8"RenderDrawColor", frame.draw_colors, peak.draw_colors);
+			row(u8"RenderClipRect", frame.clip_rects, peak.clip_rects);
+			row(u8"render targets", frame.target_switches, peak.target_switches);
+			ImGui::EndTable();
+		}
+		if (ImGui::Button(u8"Reset peak")) render::reset_peak();
+		ImGui::End();
+	}
+
+	std::shared_ptr<asset_loader> _loader;
+	// コンテキストより長く生きる必要がある
+	std::unique_ptr<ImFontAtlas> _imgui_fonts;
 	SDL_Pointer<SDL_Texture> _tex;
 	std::shared_ptr<font_set> _font;
 	console _console;
+	message_log _log;
+	compositor _compositor;
+	compositor::layer_id _background_layer = compositor::layer_none;
+	compositor::layer_id _sprite_layer = compositor::layer_none;
+	compositor::layer_id _console_layer = compositor::layer_none;
 };
 
 } // namespace game
 
 int main(int argc, char **argv) {
 	int result = 0;
-	if (::game app{}; app.initialize()) {
+	::game app{};
+	app.command_line(argc, argv);
+	if (app.initialize()) {
 		result = app.boot();
 	}
 	return result;
@@ -0,0 +1,183 @@
+﻿#ifndef MESSAGE_LOG_HPP_
+#define MESSAGE_LOG_HPP_
+
+#include <SDL.h>
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <string_view>
+
+#include "console.hpp"
+#include "utf8.hpp"
+#include "alloc_tracker.hpp"
+
+/**
+*  Scrollback log shown in a rectangular area of a console.
+*
+*  Lines are decoded and wrapped to the area width when added and kept in a
+*  fixed-capacity ring of rows; the oldest rows are dropped once it is full.
+*  Only the rows currently visible are written to the console, and scrolling
+*  by fewer rows than the area height moves the console contents so just the
+*  newly exposed rows are drawn.
+*/
+class message_log {
+public:
+	explicit message_log(std::size_t capacity = 10000) : _capacity(std::max<std::size_t>(capacity, 1)) {}
+
+	// area はセル単位、幅が変わると中身は消える
+	void attach(console& target, const SDL_Rect& area) {
+		_console = &target;
+		if (area.w != _area.w) {
+			_area = area;
+			clear();
+
+		} else {
+			_area = area;
+			redraw();
+		}
+	}
+
+	void detach() { _console = nullptr; }
+
+	void clear() {
+		_text.assign(_capacity * std::max(_area.w, 0), U'\0');
+		_rows.assign(_capacity, row{});
+		_head = 0;
+		_count = 0;
+		_offset = 0;
+		redraw();
+	}
+
+	inline void add(std::string_view string, const SDL_Color& color) {
+		add_codepoints(utf8::codepoints(string), color);
+	}
+
+	inline void add(std::u32string_view string, const SDL_Color& color) {
+		add_codepoints(string, color);
+	}
+
+	template<typename Text>
+	inline void add(const Text& string) {
+		add(string, _console ? _console->fg_color() : SDL_Color{ 0xFF, 0xFF, 0xFF, 0xFF });
+	}
+
+	template<typename Codepoints>
+	void add_codepoints(const Codepoints& codepoints, const SDL_Color& color) {
+		ALLOC_SCOPE("message_log::add");
+		if (_area.w <= 0) return;
+
+		int added = 1;
+		std::size_t slot = push_row(color);
+		for (char32_t codepoint : codepoints) {
+			if (codepoint == '\r') continue;
+			if (codepoint == '\n' || _rows[slot].length >= _area.w) {
+				slot = push_row(color);
+				++added;
+				if (codepoint == '\n') continue;
+			}
+			text(slot)[_rows[slot].length++] = codepoint;
+		}
+
+		if (_offset > 0) {
+			// 遡って読んでいる間は表示位置を動かさない
+			// 表示中の行が上書きされて一番古い行で止まったら、その分だけ送る
+			const int offset = _offset + added;
+			_offset = std::min(offset, max_offset());
+			shift(offset - _offset);
+
+		} else {
+			shift(added);
+		}
+	}
+
+	// 正の値で古い方へ
+	void scroll(int lines) {
+		const int offset = std::clamp(_offset + lines, 0, max_offset());
+		const int delta = offset - _offset;
+		_offset = offset;
+		shift(-delta);
+	}
+
+	inline void scroll_to_end() { scroll(-_offset); }
+
+	inline std::size_t size() const { return _count; }
+	inline std::size_t capacity() const { return _capacity; }
+	inline int offset() const { return _offset; }
+	inline const SDL_Rect& area() const { return _area; }
+
+private:
+	struct row {
+		std::uint16_t length = 0;
+		SDL_Color color{};
+	};
+
+	std::size_t push_row(const SDL_Color& color) {
+		std::size_t slot = (_head + _count) % _capacity;
+		if (_count == _capacity) {
+			_head = (_head + 1) % _capacity;
+
+		} else {
+			++_count;
+		}
+		_rows[slot] = { 0, color };
+		return slot;
+	}
+
+	inline char32_t* text(std::size_t slot) { return &_text[slot * _area.w]; }
+
+	inline int max_offset() const {
+		return std::max(static_cast<int>(_count) - _area.h, 0);
+	}
+
+	// 表示を lines 行だけ上へ送り、空いた行だけ書き直す
+	void shift(int lines) {
+		if (!_console || _area.w <= 0 || lines == 0) return;
+		if (std::abs(lines) >= _area.h) {
+			redraw();
+			return;
+		}
+		_console->scroll(_area, lines);
+		const int first = (lines > 0) ? (_area.h - lines) : 0;
+		for (int y = first; y < first + std::abs(lines); ++y) draw_row(y);
+	}
+
+	void redraw() {
+		if (!_console || _area.w <= 0) return;
+		for (int y = 0; y < _area.h; ++y) draw_row(y);
+	}
+
+	// 表示範囲の y 行目に当たる行だけをセルに書く
+	void draw_row(int y) {
+		const int index = static_cast<int>(_count) - _offset - _area.h + y;
+		const std::size_t slot = (index < 0) ? 0 : (_head + index) % _capacity;
+		const int length = (index < 0) ? 0 : _rows[slot].length;
+
+		// 空きは scroll() が埋める空セルと揃えておく
+		console_cell c{};
+		c.fg = _rows[slot].color;
+		const char32_t* chars = text(slot);
+		for (int x = 0; x < _area.w; ++x) {
+			if (x < length) {
+				c.codepoint = chars[x];
+				_console->put(_area.x + x, _area.y + y, c);
+
+			} else {
+				_console->put(_area.x + x, _area.y + y, console_cell{});
+			}
+		}
+	}
+
+	std::size_t _capacity;
+	console* _console = nullptr;
+	SDL_Rect _area{};
+
+	std::vector<char32_t> _text;
+	std::vector<row> _rows;
+	std::size_t _head = 0;
+	std::size_t _count = 0;
+	int _offset = 0;
+};
+
+#endif // MESSAGE_LOG_HPP_
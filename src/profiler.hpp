@@ -0,0 +1,206 @@
+﻿#ifndef PROFILER_HPP_
+#define PROFILER_HPP_
+
+#include <SDL.h>
+
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+// デバッグビルドでは常に有効、リリースでは WIZLIKE_PROFILE を定義したときだけ
+#if !defined(WIZLIKE_PROFILE) && !defined(NDEBUG)
+#define WIZLIKE_PROFILE 1
+#endif
+
+/**
+*  Scoped zone timing.
+*
+*  PROFILE_ZONE() times the rest of the enclosing block and pushes the
+*  result into a lock-free ring owned by the calling thread. Once a frame,
+*  next_frame() drains every ring on the main thread into a rolling history
+*  of frame times with per-zone totals. Zones compile to nothing unless
+*  WIZLIKE_PROFILE is set.
+*/
+namespace profiler {
+
+struct zone_event {
+	const char* name;
+	Uint64 begin;
+	Uint64 end;
+	std::uint16_t depth;
+	std::uint16_t thread;
+};
+
+/**
+*  Single-producer, single-consumer ring of zone events. The owning thread
+*  pushes, the main thread drains; events are dropped when it is full.
+*/
+class event_ring {
+public:
+	static constexpr std::size_t capacity = 4096;
+
+	explicit event_ring(std::uint16_t thread) : _thread(thread) {}
+
+	inline std::uint16_t thread() const { return _thread; }
+
+	inline bool push(const zone_event& e) {
+		const std::size_t write = _write.load(std::memory_order_relaxed);
+		if (write - _read.load(std::memory_order_acquire) >= capacity) {
+			_dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		_events[write & (capacity - 1)] = e;
+		_write.store(write + 1, std::memory_order_release);
+		return true;
+	}
+
+	template<typename F>
+	void drain(F&& f) {
+		std::size_t read = _read.load(std::memory_order_relaxed);
+		const std::size_t write = _write.load(std::memory_order_acquire);
+		for (; read != write; ++read) f(_events[read & (capacity - 1)]);
+		_read.store(read, std::memory_order_release);
+	}
+
+	inline std::size_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+private:
+	static_assert((capacity & (capacity - 1)) == 0, "capacity must be a power of two");
+
+	std::uint16_t _thread;
+	std::atomic<std::size_t> _write{ 0 };
+	std::atomic<std::size_t> _read{ 0 };
+	std::atomic<std::size_t> _dropped{ 0 };
+	zone_event _events[capacity];
+};
+
+static constexpr int max_zones = 32;
+static constexpr int history_size = 240;
+
+#if defined(WIZLIKE_PROFILE)
+static constexpr bool enabled = true;
+#else
+static constexpr bool enabled = false;
+#endif
+
+namespace detail {
+
+inline std::mutex rings_mutex;
+inline std::vector<std::unique_ptr<event_ring>> rings;
+inline thread_local event_ring* local_ring = nullptr;
+inline thread_local std::uint16_t depth = 0;
+
+// スレッドごとに最初の 1 回だけ登録する
+inline event_ring& ring() {
+	if (!local_ring) {
+		std::lock_guard<std::mutex> lock(rings_mutex);
+		rings.push_back(std::make_unique<event_ring>(static_cast<std::uint16_t>(rings.size())));
+		local_ring = rings.back().get();
+	}
+	return *local_ring;
+}
+
+// メインスレッドだけが触る集計
+inline const char* zone_names[max_zones];
+inline int zone_count = 0;
+inline float frame_ms[history_size];
+inline float zone_ms[max_zones][history_size];
+inline int history_head = 0;
+inline int history_count = 0;
+inline Uint64 frame_begin = 0;
+
+inline int zone_index(const char* name) {
+	for (int i = 0; i < zone_count; ++i) {
+		if (zone_names[i] == name || std::strcmp(zone_names[i], name) == 0) return i;
+	}
+	if (zone_count >= max_zones) return -1;
+	zone_names[zone_count] = name;
+	for (auto& ms : zone_ms[zone_count]) ms = 0.f;
+	return zone_count++;
+}
+
+} // namespace detail
+
+class zone {
+public:
+	explicit zone(const char* name) : _name(name), _begin(SDL_GetPerformanceCounter()) { ++detail::depth; }
+	~zone() {
+		--detail::depth;
+		auto& ring = detail::ring();
+		ring.push({ _name, _begin, SDL_GetPerformanceCounter(), detail::depth, ring.thread() });
+	}
+
+	zone(const zone&) = delete;
+	zone& operator=(const zone&) = delete;
+
+private:
+	const char* _name;
+	Uint64 _begin;
+};
+
+/**
+*  Close the current frame: drain every thread's events into the history
+*  and start timing the next frame. Called by application::boot() after
+*  present, so idle wakeups that draw nothing never enter the history.
+*  Every drained event is also passed to on_event (e.g. trace_capture).
+*/
+template<typename F>
+void next_frame(F&& on_event) {
+	const Uint64 now = SDL_GetPerformanceCounter();
+	const double to_ms = 1000.0 / static_cast<double>(SDL_GetPerformanceFrequency());
+	const int slot = detail::history_head;
+
+	detail::frame_ms[slot] = detail::frame_begin ? static_cast<float>((now - detail::frame_begin) * to_ms) : 0.f;
+	for (int i = 0; i < detail::zone_count; ++i) detail::zone_ms[i][slot] = 0.f;
+	{
+		std::lock_guard<std::mutex> lock(detail::rings_mutex);
+		for (auto& ring : detail::rings) {
+			ring->drain([&](const zone_event& e) {
+				if (int index = detail::zone_index(e.name); index >= 0) {
+					detail::zone_ms[index][slot] += static_cast<float>((e.end - e.begin) * to_ms);
+				}
+				on_event(e);
+			});
+		}
+	}
+
+	detail::frame_begin = now;
+	detail::history_head = (slot + 1) % history_size;
+	detail::history_count = std::min(detail::history_count + 1, history_size);
+}
+
+inline void next_frame() { next_frame([](const zone_event&) {}); }
+
+// 描かずに眠っていた時間をフレーム時間に入れない
+inline void restart_frame() { detail::frame_begin = SDL_GetPerformanceCounter(); }
+
+// 履歴は古い順に offset() から history_size 個並ぶ (PlotLines の values_offset にそのまま渡せる)
+inline const float* frame_times() { return detail::frame_ms; }
+inline const float* zone_times(int zone) { return detail::zone_ms[zone]; }
+inline int offset() { return detail::history_head; }
+inline int history_count() { return detail::history_count; }
+
+// 直前のフレーム
+inline float last_frame_time() { return detail::frame_ms[(detail::history_head + history_size - 1) % history_size]; }
+inline float last_zone_time(int zone) { return detail::zone_ms[zone][(detail::history_head + history_size - 1) % history_size]; }
+
+inline int zone_count() { return detail::zone_count; }
+inline const char* zone_name(int zone) { return detail::zone_names[zone]; }
+
+} // namespace profiler
+
+#define PROFILER_CONCAT_(a, b) a##b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT_(a, b)
+
+#if defined(WIZLIKE_PROFILE)
+#define PROFILE_ZONE(NAME) profiler::zone PROFILER_CONCAT(profile_zone_, __LINE__)(NAME)
+#else
+#define PROFILE_ZONE(NAME) ((void)0)
+#endif
+
+#endif // PROFILER_HPP_
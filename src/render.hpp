@@ -0,0 +1,152 @@
+﻿#ifndef RENDER_HPP_
+#define RENDER_HPP_
+
+#include <SDL.h>
+
+#include <cstdint>
+
+/**
+*  Thin wrappers over the SDL render calls used by font, console and
+*  compositor that count draw calls and state changes per frame.
+*
+*  Only calls that go through this layer are counted; ImGui's own renderer
+*  backend is not included.
+*/
+namespace render {
+
+struct stats {
+	// 描画呼び出し
+	std::uint32_t copies = 0;
+	std::uint32_t fill_rects = 0;
+	std::uint32_t geometries = 0;
+	std::uint32_t clears = 0;
+
+	// 描いたもの
+	std::uint32_t rects = 0;
+	std::uint32_t vertices = 0;
+	std::uint32_t indices = 0;
+
+	// 状態の変更
+	std::uint32_t texture_binds = 0;
+	std::uint32_t color_mods = 0;
+	std::uint32_t draw_colors = 0;
+	std::uint32_t clip_rects = 0;
+	std::uint32_t target_switches = 0;
+
+	inline std::uint32_t draw_calls() const { return copies + fill_rects + geometries + clears; }
+	inline std::uint32_t state_changes() const { return texture_binds + color_mods + draw_colors + clip_rects + target_switches; }
+};
+
+namespace detail {
+
+// 描画はメインスレッドだけで行う
+inline stats current;
+inline stats last;
+inline stats peak;
+
+// 直前の描画呼び出しで使ったテクスチャ、塗りつぶしとターゲットの切り替えで外れる
+inline SDL_Texture* bound = nullptr;
+
+inline void bind(SDL_Texture* texture) {
+	if (texture && texture != bound) ++current.texture_binds;
+	bound = texture;
+}
+
+inline void max(std::uint32_t& lhs, std::uint32_t rhs) { if (rhs > lhs) lhs = rhs; }
+
+} // namespace detail
+
+inline int copy(SDL_Renderer* renderer, SDL_Texture* texture, const SDL_Rect* src, const SDL_Rect* dst) {
+	++detail::current.copies;
+	detail::bind(texture);
+	return SDL_RenderCopy(renderer, texture, src, dst);
+}
+
+inline int fill_rect(SDL_Renderer* renderer, const SDL_Rect* rect) {
+	++detail::current.fill_rects;
+	++detail::current.rects;
+	detail::bind(nullptr);
+	return SDL_RenderFillRect(renderer, rect);
+}
+
+inline int fill_rects(SDL_Renderer* renderer, const SDL_Rect* rects, int count) {
+	++detail::current.fill_rects;
+	detail::current.rects += count;
+	detail::bind(nullptr);
+	return SDL_RenderFillRects(renderer, rects, count);
+}
+
+inline int geometry(SDL_Renderer* renderer, SDL_Texture* texture, const SDL_Vertex* vertices, int num_vertices, const int* indices, int num_indices) {
+	++detail::current.geometries;
+	detail::current.vertices += num_vertices;
+	detail::current.indices += num_indices;
+	detail::bind(texture);
+	return SDL_RenderGeometry(renderer, texture, vertices, num_vertices, indices, num_indices);
+}
+
+inline int clear(SDL_Renderer* renderer) {
+	++detail::current.clears;
+	return SDL_RenderClear(renderer);
+}
+
+inline int draw_color(SDL_Renderer* renderer, Uint8 r, Uint8 g, Uint8 b, Uint8 a) {
+	++detail::current.draw_colors;
+	return SDL_SetRenderDrawColor(renderer, r, g, b, a);
+}
+
+// グリフは頂点カラーで色を付けるので今は使っていない、使い始めたら数に出る
+inline int color_mod(SDL_Texture* texture, Uint8 r, Uint8 g, Uint8 b) {
+	++detail::current.color_mods;
+	return SDL_SetTextureColorMod(texture, r, g, b);
+}
+
+// nullptr で解除するのも 1 回と数える
+inline int clip_rect(SDL_Renderer* renderer, const SDL_Rect* rect) {
+	++detail::current.clip_rects;
+	return SDL_RenderSetClipRect(renderer, rect);
+}
+
+// 同じターゲットへの切り替えは SDL 側で何もしないので数えない
+inline int target(SDL_Renderer* renderer, SDL_Texture* texture) {
+	if (SDL_GetRenderTarget(renderer) != texture) {
+		++detail::current.target_switches;
+		detail::bind(nullptr);
+	}
+	return SDL_SetRenderTarget(renderer, texture);
+}
+
+/**
+*  Close the current frame's counters. Called by application::boot() after
+*  SDL_RenderPresent, so frames skipped in idle mode keep the last values.
+*/
+inline void next_frame() {
+	auto& c = detail::current;
+	auto& p = detail::peak;
+	detail::max(p.copies, c.copies);
+	detail::max(p.fill_rects, c.fill_rects);
+	detail::max(p.geometries, c.geometries);
+	detail::max(p.clears, c.clears);
+	detail::max(p.rects, c.rects);
+	detail::max(p.vertices, c.vertices);
+	detail::max(p.indices, c.indices);
+	detail::max(p.texture_binds, c.texture_binds);
+	detail::max(p.color_mods, c.color_mods);
+	detail::max(p.draw_colors, c.draw_colors);
+	detail::max(p.clip_rects, c.clip_rects);
+	detail::max(p.target_switches, c.target_switches);
+
+	detail::last = c;
+	c = stats{};
+	detail::bound = nullptr;
+}
+
+// 直前に表示したフレームの値
+inline const stats& frame() { return detail::last; }
+
+// 項目ごとの最大値 (同じフレームの値とは限らない)
+inline const stats& peak() { return detail::peak; }
+inline void reset_peak() { detail::peak = stats{}; }
+
+} // namespace render
+
+#endif // RENDER_HPP_
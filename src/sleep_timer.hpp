@@ -0,0 +1,76 @@
+﻿#ifndef SLEEP_TIMER_HPP_
+#define SLEEP_TIMER_HPP_
+
+#include <SDL.h>
+
+#include <cstdint>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#else
+#include <cerrno>
+#include <time.h>
+#endif
+
+/**
+*  Sleeps with sub-millisecond resolution where the OS offers it, without
+*  spinning: a high-resolution waitable timer on Windows 10 1803 and later,
+*  nanosleep elsewhere. Either still wakes up late by the scheduler's
+*  slack (tens of microseconds on Linux, up to about 0.5 ms on Windows).
+*  Without a high-resolution timer it falls back to SDL_Delay, rounding
+*  down, so it wakes up to 1 ms early instead of late.
+*/
+class sleep_timer {
+public:
+	sleep_timer() {
+#ifdef _WIN32
+		_timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+#endif
+	}
+	~sleep_timer() {
+#ifdef _WIN32
+		if (_timer) CloseHandle(_timer);
+#endif
+	}
+
+	sleep_timer(const sleep_timer&) = delete;
+	sleep_timer& operator=(const sleep_timer&) = delete;
+
+	void sleep(std::uint64_t nanoseconds) {
+		if (nanoseconds == 0) return;
+#ifdef _WIN32
+		if (_timer) {
+			// 負の値は相対時間、100ns 単位
+			LARGE_INTEGER due{};
+			due.QuadPart = -static_cast<LONGLONG>(nanoseconds / 100);
+			if (due.QuadPart < 0 && SetWaitableTimer(_timer, &due, 0, nullptr, nullptr, FALSE)) {
+				WaitForSingleObject(_timer, INFINITE);
+				return;
+			}
+		}
+		SDL_Delay(static_cast<Uint32>(nanoseconds / 1000000));
+#else
+		timespec request{ static_cast<time_t>(nanoseconds / 1000000000), static_cast<long>(nanoseconds % 1000000000) };
+		timespec remaining{};
+		while (nanosleep(&request, &remaining) != 0 && errno == EINTR) {
+			request = remaining;
+		}
+#endif
+	}
+
+private:
+#ifdef _WIN32
+	HANDLE _timer = nullptr;
+#endif
+};
+
+#endif // SLEEP_TIMER_HPP_
@@ -0,0 +1,167 @@
+﻿#ifndef TRACE_CAPTURE_HPP_
+#define TRACE_CAPTURE_HPP_
+
+#include <SDL.h>
+
+#include <fstream>
+#include <iomanip>
+#include <filesystem>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+
+#include "profiler.hpp"
+#include "alloc_tracker.hpp"
+
+/**
+*  Records profiler zones of the next N frames into a Chrome Trace Event
+*  JSON file (chrome://tracing, Perfetto).
+*
+*  The main thread only appends drained events to a fixed-capacity buffer
+*  and hands it over once per frame; a writer thread formats and writes
+*  them. Events that don't fit are dropped and counted instead of growing
+*  the buffer in the middle of a frame.
+*/
+class trace_capture {
+public:
+	trace_capture() {}
+	~trace_capture() {
+		stop();
+		join();
+	}
+
+	trace_capture(const trace_capture&) = delete;
+	trace_capture& operator=(const trace_capture&) = delete;
+
+	bool start(const std::filesystem::path& path, int frames) {
+		if (capturing() || frames <= 0) return false;
+		join();
+
+		_frames = frames;
+		_pending.clear();
+		_pending.reserve(capacity);
+		_queue.reserve(capacity);
+		_dropped = 0;
+		_closing = false;
+		_origin = SDL_GetPerformanceCounter();
+		_capturing = true;
+		_writer = std::thread([this, path] { write(path); });
+		return true;
+	}
+
+	// 残りは書き出しスレッドが書き終えてから閉じる、ここでは待たない
+	void stop() {
+		if (_capturing) {
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_closing = true;
+			}
+			_ready.notify_one();
+			_capturing = false;
+		}
+	}
+
+	inline bool capturing() const { return _capturing; }
+
+	// 今回の取得で、バッファが一杯で捨てたイベントの数
+	inline std::size_t dropped() const { return _dropped; }
+
+	// profiler::next_frame() から呼ぶ、開始前に始まったゾーンは捨てる
+	inline void add(const profiler::zone_event& e) {
+		if (!_capturing || e.begin < _origin) return;
+		if (_pending.size() < _pending.capacity()) {
+			_pending.push_back(e);
+
+		} else {
+			++_dropped;
+		}
+	}
+
+	void end_frame() {
+		if (!_capturing) return;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (_queue.empty()) {
+				_queue.swap(_pending);
+
+			} else {
+				// 書き出しが追いついていなければ、入る分だけ渡して残りは捨てる
+				const std::size_t room = std::min(_pending.size(), _queue.capacity() - _queue.size());
+				_queue.insert(_queue.end(), _pending.begin(), _pending.begin() + room);
+				_dropped += _pending.size() - room;
+			}
+			_pending.clear();
+			if (--_frames <= 0) _closing = true;
+		}
+		_ready.notify_one();
+		if (_closing) _capturing = false;
+	}
+
+private:
+	// 3 本のバッファ (_pending, _queue, 書き出し側) が同じ容量のまま入れ替わる
+	static constexpr std::size_t capacity = 16 * 1024;
+
+	// 前の書き出しが終わるのを待つ、次の start() かデストラクタで呼ぶ
+	void join() {
+		if (_writer.joinable()) _writer.join();
+	}
+
+	void write(std::filesystem::path path) {
+		// 書式化と書き出しの確保はフレームと無関係に起きるので --alloc-check の対象から外す
+		alloc_tracker::ignore_this_thread();
+		std::ofstream out(path, std::ios::binary);
+		if (!out) {
+			SDL_Log("trace_capture: can't open %s", path.string().c_str());
+			_capturing = false;
+			return;
+		}
+		out << std::fixed << std::setprecision(3) << "{\"traceEvents\":[\n";
+
+		const double to_us = 1000000.0 / static_cast<double>(SDL_GetPerformanceFrequency());
+		bool first = true;
+		std::vector<profiler::zone_event> events;
+		events.reserve(capacity);
+		for (;;) {
+			bool closing = false;
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_ready.wait(lock, [this] { return !_queue.empty() || _closing; });
+				events.swap(_queue);
+				closing = _closing;
+			}
+			for (auto& e : events) {
+				out << (first ? "" : ",\n")
+					<< "{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.thread
+					<< ",\"ts\":" << (e.begin - _origin) * to_us << ",\"dur\":" << (e.end - e.begin) * to_us << "}";
+				first = false;
+			}
+			events.clear();
+			if (closing) break;
+		}
+
+		out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+		if (const std::size_t dropped = _dropped) {
+			SDL_Log("trace_capture: wrote %s, dropped %zu events", path.string().c_str(), dropped);
+
+		} else {
+			SDL_Log("trace_capture: wrote %s", path.string().c_str());
+		}
+	}
+
+	std::thread _writer;
+	std::mutex _mutex;
+	std::condition_variable _ready;
+
+	std::vector<profiler::zone_event> _pending;
+	std::vector<profiler::zone_event> _queue;
+	Uint64 _origin = 0;
+	int _frames = 0;
+	bool _closing = false;
+	std::atomic<bool> _capturing{ false };
+	std::atomic<std::size_t> _dropped{ 0 };
+};
+
+#endif // TRACE_CAPTURE_HPP_
@@ -0,0 +1,250 @@
+﻿#ifndef UTF8_HPP_
+#define UTF8_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <algorithm>
+#include <string_view>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define UTF8_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define UTF8_SSE2 1
+#endif
+
+namespace utf8_detail {
+
+/**
+*  Widen the leading ASCII bytes of in[0, n) into out and return how many
+*  there were. Whole 16/32-byte blocks are stored at once, so out may be
+*  written past the returned count, but never past n.
+*/
+inline std::size_t widen_ascii(const unsigned char* in, std::size_t n, char32_t* out) {
+	std::size_t i = 0;
+#if defined(UTF8_AVX2)
+	for (; i + 32 <= n; i += 32) {
+		const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+		for (int k = 0; k < 4; ++k) {
+			const __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + i + k * 8));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i + k * 8), _mm256_cvtepu8_epi32(bytes));
+		}
+		if (const unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(v))) {
+			while ((mask & (1u << (i & 31))) == 0) ++i;
+			return i;
+		}
+	}
+#elif defined(UTF8_SSE2)
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= n; i += 16) {
+		const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+		const __m128i lo = _mm_unpacklo_epi8(v, zero);
+		const __m128i hi = _mm_unpackhi_epi8(v, zero);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 0), _mm_unpacklo_epi16(lo, zero));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 4), _mm_unpackhi_epi16(lo, zero));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 8), _mm_unpacklo_epi16(hi, zero));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 12), _mm_unpackhi_epi16(hi, zero));
+		if (const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(v))) {
+			while ((mask & (1u << (i & 15))) == 0) ++i;
+			return i;
+		}
+	}
+#endif
+	for (; i < n && in[i] < 0x80; ++i) out[i] = in[i];
+	return i;
+}
+
+/**
+*  Decode the leading run of 3-byte sequences (U+0800-U+FFFF, which covers
+*  kana and most kanji) in in[0, n) four at a time: one compare checks the
+*  lead and continuation bits of 12 bytes, then overlong forms and
+*  surrogates are rejected per codepoint. Stops at the first block that
+*  doesn't qualify, so the caller decodes the rest. Reads 16 bytes per
+*  block; returns the number of codepoints written (3 bytes each).
+*/
+inline std::size_t decode_three_byte(const unsigned char* in, std::size_t n, char32_t* out, std::size_t capacity) {
+	std::size_t count = 0;
+#if defined(UTF8_AVX2) || defined(UTF8_SSE2)
+	const char F0 = static_cast<char>(0xF0), C0 = static_cast<char>(0xC0);
+	const char E0 = static_cast<char>(0xE0), X80 = static_cast<char>(0x80);
+	const __m128i mask = _mm_setr_epi8(F0, C0, C0, F0, C0, C0, F0, C0, C0, F0, C0, C0, 0, 0, 0, 0);
+	const __m128i expected = _mm_setr_epi8(E0, X80, X80, E0, X80, X80, E0, X80, X80, E0, X80, X80, 0, 0, 0, 0);
+	while (count + 4 <= capacity && count * 3 + 16 <= n) {
+		const unsigned char* p = in + count * 3;
+		const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(v, mask), expected)) != 0xFFFF) break;
+
+		char32_t codepoints[4];
+		bool valid = true;
+		for (int k = 0; k < 4; ++k, p += 3) {
+			const char32_t c = (char32_t(p[0] & 0x0F) << 12) | (char32_t(p[1] & 0x3F) << 6) | char32_t(p[2] & 0x3F);
+			valid &= (c >= 0x800) & ((c - 0xD800) >= 0x800);
+			codepoints[k] = c;
+		}
+		if (!valid) break;
+		std::copy(codepoints, codepoints + 4, out + count);
+		count += 4;
+	}
+#endif
+	return count;
+}
+
+} // namespace utf8_detail
+
+namespace utf8 {
+
+static constexpr char32_t replacement = 0xFFFD;
+
+/**
+*  Decode one codepoint at it and advance past it. Malformed sequences,
+*  overlong forms and surrogates decode to U+FFFD and consume one byte.
+*/
+inline char32_t decode(const char*& it, const char* end) {
+	const auto* p = reinterpret_cast<const unsigned char*>(it);
+	const unsigned char lead = p[0];
+	if (lead < 0x80) {
+		++it;
+		return lead;
+	}
+
+	int length = 0;
+	char32_t codepoint = 0;
+	char32_t min = 0;
+	if ((lead & 0xE0) == 0xC0) {
+		length = 2; codepoint = lead & 0x1F; min = 0x80;
+
+	} else if ((lead & 0xF0) == 0xE0) {
+		length = 3; codepoint = lead & 0x0F; min = 0x800;
+
+	} else if ((lead & 0xF8) == 0xF0) {
+		length = 4; codepoint = lead & 0x07; min = 0x10000;
+
+	} else {
+		++it;
+		return replacement;
+	}
+	if (end - it < length) {
+		++it;
+		return replacement;
+	}
+	for (int i = 1; i < length; ++i) {
+		if ((p[i] & 0xC0) != 0x80) {
+			++it;
+			return replacement;
+		}
+		codepoint = (codepoint << 6) | (p[i] & 0x3F);
+	}
+	if (codepoint < min || codepoint > 0x10FFFF || (codepoint >= 0xD800 && codepoint <= 0xDFFF)) {
+		++it;
+		return replacement;
+	}
+	it += length;
+	return codepoint;
+}
+
+/**
+*  Decode up to capacity codepoints from [it, end) into out and advance it.
+*  ASCII runs are widened a vector at a time and runs of 3-byte sequences
+*  are classified four at a time; everything else, and the tail of a run
+*  too short for a whole block, goes through the validating decode()
+*  above. Returns the number of codepoints written.
+*/
+inline std::size_t decode(const char*& it, const char* end, char32_t* out, std::size_t capacity) {
+	std::size_t count = 0;
+	while (it != end && count < capacity) {
+		if (static_cast<unsigned char>(*it) < 0x80) {
+			const std::size_t room = std::min<std::size_t>(end - it, capacity - count);
+			const std::size_t n = utf8_detail::widen_ascii(reinterpret_cast<const unsigned char*>(it), room, out + count);
+			it += n;
+			count += n;
+
+		} else {
+			std::size_t n = 0;
+			if ((static_cast<unsigned char>(*it) & 0xF0) == 0xE0) {
+				n = utf8_detail::decode_three_byte(reinterpret_cast<const unsigned char*>(it), end - it, out + count, capacity - count);
+			}
+			if (n > 0) {
+				it += n * 3;
+				count += n;
+
+			} else {
+				out[count++] = decode(it, end);
+			}
+		}
+	}
+	return count;
+}
+
+/**
+*  Single-pass range over the codepoints of a UTF-8 std::string_view.
+*  Decodes into a small internal buffer a chunk at a time, so print loops
+*  get the bulk decoder without allocating or copying the string.
+*/
+class codepoint_range {
+public:
+	static constexpr std::size_t chunk_size = 64;
+
+	explicit codepoint_range(std::string_view string) : _string(string) {}
+
+	class iterator {
+	public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = char32_t;
+		using difference_type = std::ptrdiff_t;
+		using pointer = const char32_t*;
+		using reference = char32_t;
+
+		iterator() {}
+		explicit iterator(const codepoint_range* range) : _range(range) { refill(); }
+
+		inline char32_t operator*() const { return *_current; }
+
+		inline iterator& operator++() {
+			if (++_current == _last) refill();
+			return *this;
+		}
+
+		inline bool operator==(const iterator& rhs) const { return _current == rhs._current; }
+		inline bool operator!=(const iterator& rhs) const { return _current != rhs._current; }
+
+	private:
+		// 使い切ったら次のチャンクを読む、終わりなら end() と同じ nullptr になる
+		inline void refill() {
+			const std::size_t size = _range->refill();
+			_current = size ? _range->_chunk : nullptr;
+			_last = size ? _range->_chunk + size : nullptr;
+		}
+
+		const codepoint_range* _range = nullptr;
+		const char32_t* _current = nullptr;
+		const char32_t* _last = nullptr;
+	};
+
+	inline iterator begin() const {
+		_it = _string.data();
+		return iterator(this);
+	}
+	inline iterator end() const { return iterator(); }
+
+private:
+	inline std::size_t refill() const {
+		return decode(_it, _string.data() + _string.size(), _chunk, chunk_size);
+	}
+
+	std::string_view _string;
+
+	// 走査中の状態 (1 回だけ回せる)
+	mutable const char* _it = nullptr;
+	mutable char32_t _chunk[chunk_size];
+};
+
+inline codepoint_range codepoints(std::string_view string) { return codepoint_range(string); }
+
+// 既にデコード済みならそのまま
+inline std::u32string_view codepoints(std::u32string_view string) { return string; }
+
+} // namespace utf8
+
+#endif // UTF8_HPP_
@@ -5,10 +5,12 @@
 #include <memory>
 #include <string>
 #include <vector>
+#include <memory_resource>
 #include <charconv>
 #include <iostream>
+#include <cstdarg>
+#include <cstdio>
 
-#include <tinyutf8.h>
 #include "SDL_stb_image.hpp"
 
 template<typename T>
@@ -98,46 +100,21 @@ SDL_Texture *SDL_LoadTexture(SDL_Renderer *renderer, const char *path) {
 	return ptr;
 }
 
-std::vector<std::string> split(const std::string& s, char delim) {
-	std::vector<std::string> elems;
-	std::string item;
-	for (char ch : s) {
-		if (ch == delim) {
-			if (!item.empty())
-				elems.push_back(item);
-			item.clear();
-
-		} else {
-			item += ch;
-		}
-	}
-	if (!item.empty())
-		elems.push_back(item);
-	return elems;
-}
-
-int to_int(const std::string& str) {
-	int value = 0;
-	if (auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), value); ec == std::errc{}) {
-	}
-	return value;
-}
-
-std::vector<tiny_utf8::utf8_string> split_lines(const tiny_utf8::utf8_string &s) {
-	std::vector<tiny_utf8::utf8_string> lines;
-	tiny_utf8::utf8_string line;
-	for (const auto &codepoint : s) {
-		if ((codepoint == '\n') || (codepoint == '\r')) {
-			if (line.size() > 0) {
-				lines.push_back(line);
-				line.clear();
-			}
-
-		} else {
-			line += codepoint;
-		}
+// 書式化した文字列を resource (frame_arena など) から確保する
+std::pmr::string string_format(std::pmr::memory_resource* resource, const char* format, ...) {
+	std::pmr::string result(resource);
+	va_list args;
+	va_start(args, format);
+	va_list size_args;
+	va_copy(size_args, args);
+	int size = std::vsnprintf(nullptr, 0, format, size_args);
+	va_end(size_args);
+	if (size > 0) {
+		result.resize(static_cast<std::size_t>(size));
+		std::vsnprintf(result.data(), result.size() + 1, format, args);
 	}
-	return std::move(lines);
+	va_end(args);
+	return result;
 }
 
 #endif // UTIL_HPP_
@@ -0,0 +1,122 @@
+﻿
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <map>
+#include <algorithm>
+#include <filesystem>
+
+#include "asset_pack.hpp"
+
+namespace {
+
+void write_u32(std::ofstream& out, std::uint32_t value) {
+	for (int i = 0; i < 4; ++i) out.put(static_cast<char>(value >> (8 * i)));
+}
+
+void write_u64(std::ofstream& out, std::uint64_t value) {
+	for (int i = 0; i < 8; ++i) out.put(static_cast<char>(value >> (8 * i)));
+}
+
+} // namespace
+
+// ファイルとディレクトリ以下のファイルをまとめて 1 つのパックにする
+//   asset_pack_build -o assets.pak assets
+// パックの中のパスは引数に渡したパスのまま (assets/font/unscii.fnt など)
+int main(int argc, char **argv) {
+	std::filesystem::path output;
+	std::vector<std::filesystem::path> inputs;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "-o" && (i + 1) < argc) {
+			output = argv[++i];
+
+		} else {
+			inputs.emplace_back(arg);
+		}
+	}
+	if (output.empty() || inputs.empty()) {
+		std::cerr << "usage: asset_pack_build -o output.pak input..." << std::endl;
+		return 1;
+	}
+
+	std::map<std::string, std::filesystem::path> files;
+	for (auto& input : inputs) {
+		if (std::filesystem::is_directory(input)) {
+			for (auto& entry : std::filesystem::recursive_directory_iterator(input)) {
+				if (entry.is_regular_file() && entry.path() != output) {
+					files[asset_pack_format::normalize_path(entry.path().generic_string())] = entry.path();
+				}
+			}
+
+		} else {
+			files[asset_pack_format::normalize_path(input.generic_string())] = input;
+		}
+	}
+
+	struct entry {
+		std::uint64_t hash;
+		std::uint64_t offset;
+		std::uint64_t size;
+		std::uint64_t name_offset;
+		const std::string* name;
+	};
+	std::vector<entry> entries;
+	for (auto& [name, path] : files) {
+		entries.push_back({ asset_pack_format::hash_path(name), 0, 0, 0, &name });
+	}
+	std::sort(entries.begin(), entries.end(), [](auto& a, auto& b) { return a.hash < b.hash; });
+	for (std::size_t i = 1; i < entries.size(); ++i) {
+		if (entries[i - 1].hash == entries[i].hash) {
+			std::cerr << "hash collision: " << *entries[i - 1].name << ", " << *entries[i].name << std::endl;
+			return 1;
+		}
+	}
+
+	std::ofstream out(output, std::ios::binary);
+	if (!out) {
+		std::cerr << output.string() << ": can't open." << std::endl;
+		return 1;
+	}
+	out.write(asset_pack_format::magic, sizeof(asset_pack_format::magic));
+	write_u32(out, asset_pack_format::version);
+	write_u32(out, static_cast<std::uint32_t>(entries.size()));
+	write_u32(out, 0);
+	write_u64(out, 0);
+
+	std::vector<char> buffer;
+	for (auto& e : entries) {
+		while (out.tellp() % asset_pack_format::alignment) out.put(0);
+		std::ifstream file(files[*e.name], std::ios::binary);
+		buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		e.offset = static_cast<std::uint64_t>(out.tellp());
+		e.size = buffer.size();
+		out.write(buffer.data(), buffer.size());
+	}
+
+	// find() が名前まで比べられるように、正規化したパスも入れておく
+	for (auto& e : entries) {
+		e.name_offset = static_cast<std::uint64_t>(out.tellp());
+		out.write(e.name->data(), e.name->size());
+	}
+
+	while (out.tellp() % asset_pack_format::alignment) out.put(0);
+	auto index_offset = static_cast<std::uint64_t>(out.tellp());
+	for (auto& e : entries) {
+		write_u64(out, e.hash);
+		write_u64(out, e.offset);
+		write_u64(out, e.size);
+		write_u64(out, e.name_offset);
+		write_u64(out, e.name->size());
+	}
+	out.seekp(16);
+	write_u64(out, index_offset);
+
+	if (!out) {
+		std::cerr << output.string() << ": can't write." << std::endl;
+		return 1;
+	}
+	std::cout << output.string() << ": " << entries.size() << " files" << std::endl;
+	return 0;
+}
@@ -0,0 +1,50 @@
+﻿
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <filesystem>
+
+#include "bmfont.hpp"
+
+// BMFont (XML / テキスト) を AngelCode バイナリ v3 形式に変換する
+//   bmfont_convert font.fnt...           -> font.bfnt
+//   bmfont_convert -o out.bfnt font.fnt
+int main(int argc, char **argv) {
+	std::filesystem::path output;
+	std::vector<std::filesystem::path> inputs;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "-o" && (i + 1) < argc) {
+			output = argv[++i];
+
+		} else {
+			inputs.emplace_back(arg);
+		}
+	}
+	if (inputs.empty() || (!output.empty() && inputs.size() > 1)) {
+		std::cerr << "usage: bmfont_convert [-o output.bfnt] input.fnt..." << std::endl;
+		return 1;
+	}
+
+	int result = 0;
+	std::vector<unsigned char> data;
+	for (auto& input : inputs) {
+		bmf_font bmfont;
+		if (!read_file(input, data) || !load_bmfont(data.data(), data.size(), bmfont)) {
+			std::cerr << input.string() << ": can't load." << std::endl;
+			result = 1;
+			continue;
+		}
+
+		save_bmfont_binary(bmfont, data);
+		auto path = output.empty() ? bmfont_binary_path(input) : output;
+		std::ofstream file(path, std::ios::binary);
+		if (!file.write(reinterpret_cast<const char*>(data.data()), data.size())) {
+			std::cerr << path.string() << ": can't write." << std::endl;
+			result = 1;
+			continue;
+		}
+		std::cout << input.string() << " -> " << path.string() << " (" << bmfont.chars.size() << " chars)" << std::endl;
+	}
+	return result;
+}
@@ -0,0 +1,74 @@
+﻿
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <cstdlib>
+
+#include <tinyutf8.h>
+
+#include "utf8.hpp"
+
+namespace {
+
+// 結果を捨てられないように全コードポイントを混ぜる
+volatile char32_t sink = 0;
+
+double measure(const char* name, std::size_t bytes, int iterations, const std::function<char32_t()>& f) {
+	char32_t hash = f();
+	auto begin = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; ++i) hash ^= f();
+	auto end = std::chrono::steady_clock::now();
+	sink = hash;
+
+	double seconds = std::chrono::duration<double>(end - begin).count();
+	double mb_per_s = (double(bytes) * iterations) / seconds / (1024.0 * 1024.0);
+	std::cout << "  " << std::left << std::setw(24) << name << std::right << std::fixed << std::setprecision(1) << std::setw(10) << mb_per_s << " MB/s" << std::endl;
+	return mb_per_s;
+}
+
+void run(const char* title, const std::string& text, int iterations) {
+	std::cout << title << " (" << text.size() << " bytes)" << std::endl;
+
+	tiny_utf8::utf8_string tiny(text);
+	measure("tiny_utf8 iteration", text.size(), iterations, [&] {
+		char32_t hash = 0;
+		for (char32_t codepoint : tiny) hash += codepoint;
+		return hash;
+	});
+	measure("utf8::decode scalar", text.size(), iterations, [&] {
+		char32_t hash = 0;
+		const char* it = text.data();
+		const char* end = text.data() + text.size();
+		while (it != end) hash += utf8::decode(it, end);
+		return hash;
+	});
+	measure("utf8::codepoints", text.size(), iterations, [&] {
+		char32_t hash = 0;
+		for (char32_t codepoint : utf8::codepoints(text)) hash += codepoint;
+		return hash;
+	});
+}
+
+std::string repeat(const std::string& s, std::size_t bytes) {
+	std::string result;
+	while (result.size() < bytes) result += s;
+	return result;
+}
+
+} // namespace
+
+// UTF-8 デコードの速さを tiny_utf8 と比べる
+//   utf8_bench [iterations]
+int main(int argc, char **argv) {
+	int iterations = (argc > 1) ? std::max(std::atoi(argv[1]), 1) : 200;
+	const std::size_t size = 64 * 1024;
+
+	run("status screen (ASCII)", repeat("HP  123/ 456  MP  78/ 90  LV 12  Fighter   G 1234567\n", size), iterations);
+	run("mixed", repeat(u8"ゴブリン A は 12 のダメージをうけた! Goblin A takes 12 damage!\n", size), iterations);
+	run("japanese", repeat(u8"あいうえおかきくけこさしすせそたちつてとなにぬねの\n", size), iterations);
+	return 0;
+}